@@ -0,0 +1,26 @@
+// SSD1306 OLED on I2C with a cursor moved by four pulled-up buttons
+// Fixture for the framebuffer engine: bench/sim.sh bench/chips/oled_cursor.c
+#include "wokwi-api.h"
+#include <stdlib.h>
+
+#define OLED_WIDTH 128
+#define OLED_HEIGHT 64
+
+typedef struct {
+  pin_t sda, scl, up, down, left, right, led;
+  int pixel_x, pixel_y;
+} chip_t;
+
+void chip_init(void) {
+  chip_t *chip = malloc(sizeof(chip_t));
+  chip->sda = pin_init("SDA", OUTPUT);
+  chip->scl = pin_init("SCL", OUTPUT);
+  chip->up = pin_init("Up", INPUT_PULLUP);
+  chip->down = pin_init("Down", INPUT_PULLUP);
+  chip->left = pin_init("Left", INPUT_PULLUP);
+  chip->right = pin_init("Right", INPUT_PULLUP);
+  chip->led = pin_init("LED", OUTPUT);
+  chip->pixel_x = OLED_WIDTH / 2;
+  chip->pixel_y = OLED_HEIGHT / 2;
+  i2c_init(0);
+}
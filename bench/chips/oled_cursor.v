@@ -0,0 +1,443 @@
+`timescale 1ns / 1ps
+// ============================================================
+// Generated by Perfected Wokwi2Verilog Converter
+// Module: oled_cursor
+// ============================================================
+
+module oled_cursor (
+    // Clock and Reset
+    input wire clk,
+    input wire rst_n,
+
+    // Input Pins
+    input wire Up,
+    input wire Down,
+    input wire Left,
+    input wire Right,
+
+    // Output Registers
+    output reg SDA,
+    output reg SCL,
+    output wire LED
+);
+
+    // System clock, for SPI clocks and delays in generated cores
+    parameter CLK_HZ = 32'd50000000;
+
+    // Parameters from C #defines
+    parameter OLED_WIDTH = 8'd128;
+    parameter OLED_HEIGHT = 8'd64;
+    parameter OLED_PAGES = 8;  // 64/8
+
+    // Button debouncing signals
+    reg Up_debounced;
+    reg [6:0] Up_debounce_counter;
+    reg Down_debounced;
+    reg [6:0] Down_debounce_counter;
+    reg Left_debounced;
+    reg [6:0] Left_debounce_counter;
+    reg Right_debounced;
+    reg [6:0] Right_debounce_counter;
+
+    // OLED display signals
+    reg [15:0] pixel_x;
+    reg [15:0] pixel_y;
+
+    // I2C interface signals
+    reg [6:0] i2c_address;
+    reg [7:0] i2c_data_out;
+    reg i2c_write_active;
+    reg [2:0] i2c_bit_counter;
+    reg [2:0] i2c_state;
+    reg [8:0] i2c_clk_div;
+    wire i2c_clk_enable;
+
+    // ============================================
+    // Microsecond Prescaler
+    // ============================================
+    // Exact for whole-MHz CLK_HZ
+    localparam US_CYCLES = CLK_HZ / 1000000;
+    reg [$clog2(US_CYCLES + 1)-1:0] us_count;
+    wire us_tick = (us_count == US_CYCLES - 1);
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            us_count <= 0;
+        end else if (us_tick) begin
+            us_count <= 0;
+        end else begin
+            us_count <= us_count + 1;
+        end
+    end
+
+    // ============================================
+    // Button Debouncing
+    // ============================================
+
+    // Debounce Up: follows once stable for 100 us
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            Up_debounced <= 1'b1;
+            Up_debounce_counter <= 7'd0;
+        end else begin
+            if (Up != Up_debounced) begin
+                if (Up_debounce_counter < 7'd100) begin
+                    if (us_tick) Up_debounce_counter <= Up_debounce_counter + 7'd1;
+                end else begin
+                    Up_debounced <= Up;
+                    Up_debounce_counter <= 7'd0;
+                end
+            end else begin
+                Up_debounce_counter <= 7'd0;
+            end
+        end
+    end
+
+    // Debounce Down: follows once stable for 100 us
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            Down_debounced <= 1'b1;
+            Down_debounce_counter <= 7'd0;
+        end else begin
+            if (Down != Down_debounced) begin
+                if (Down_debounce_counter < 7'd100) begin
+                    if (us_tick) Down_debounce_counter <= Down_debounce_counter + 7'd1;
+                end else begin
+                    Down_debounced <= Down;
+                    Down_debounce_counter <= 7'd0;
+                end
+            end else begin
+                Down_debounce_counter <= 7'd0;
+            end
+        end
+    end
+
+    // Debounce Left: follows once stable for 100 us
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            Left_debounced <= 1'b1;
+            Left_debounce_counter <= 7'd0;
+        end else begin
+            if (Left != Left_debounced) begin
+                if (Left_debounce_counter < 7'd100) begin
+                    if (us_tick) Left_debounce_counter <= Left_debounce_counter + 7'd1;
+                end else begin
+                    Left_debounced <= Left;
+                    Left_debounce_counter <= 7'd0;
+                end
+            end else begin
+                Left_debounce_counter <= 7'd0;
+            end
+        end
+    end
+
+    // Debounce Right: follows once stable for 100 us
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            Right_debounced <= 1'b1;
+            Right_debounce_counter <= 7'd0;
+        end else begin
+            if (Right != Right_debounced) begin
+                if (Right_debounce_counter < 7'd100) begin
+                    if (us_tick) Right_debounce_counter <= Right_debounce_counter + 7'd1;
+                end else begin
+                    Right_debounced <= Right;
+                    Right_debounce_counter <= 7'd0;
+                end
+            end else begin
+                Right_debounce_counter <= 7'd0;
+            end
+        end
+    end
+
+    // ============================================
+    // OLED Display Logic
+    // ============================================
+    
+    // Button inputs for cursor control
+    wire Up_pressed = !Up_debounced;
+    wire Down_pressed = !Down_debounced;
+    wire Left_pressed = !Left_debounced;
+    wire Right_pressed = !Right_debounced;
+    
+
+    // Cursor movement
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            pixel_x <= OLED_WIDTH / 2;
+            pixel_y <= OLED_HEIGHT / 2;
+        end else begin
+            // Move cursor based on button inputs
+            if (Up_pressed && pixel_y > 0) pixel_y <= pixel_y - 1;
+            if (Down_pressed && pixel_y < OLED_HEIGHT - 1) pixel_y <= pixel_y + 1;
+            if (Left_pressed && pixel_x > 0) pixel_x <= pixel_x - 1;
+            if (Right_pressed && pixel_x < OLED_WIDTH - 1) pixel_x <= pixel_x + 1;
+        end
+    end
+    
+
+    // Framebuffer: one byte per 8-pixel column of a page, in a synchronous
+    // RAM. Port A belongs to the engine below, port B is the scan-out read
+    // port (fb_scan_addr / fb_scan_data, one cycle latency)
+    parameter FB_DUAL_PORT = 1;     // 0 builds a single-port RAM, no scan-out port
+    localparam FB_BYTES = OLED_WIDTH * OLED_PAGES;
+    localparam FB_ADDR_BITS = $clog2(FB_BYTES);
+    reg [FB_ADDR_BITS-1:0] fb_scan_addr = 0;
+    wire [7:0] fb_scan_data;
+    wire fb_we;
+    wire [FB_ADDR_BITS-1:0] fb_addr;
+    wire [7:0] fb_wdata;
+    wire [7:0] fb_rdata;
+    
+    oled_cursor_framebuffer #(
+        .WIDTH(8),
+        .DEPTH(FB_BYTES),
+        .ADDR_BITS(FB_ADDR_BITS),
+        .DUAL_PORT(FB_DUAL_PORT)
+    ) framebuffer (
+        .clk(clk),
+        .a_we(fb_we),
+        .a_addr(fb_addr),
+        .a_wdata(fb_wdata),
+        .a_rdata(fb_rdata),
+        .b_addr(fb_scan_addr),
+        .b_rdata(fb_scan_data)
+    );
+    
+    // Framebuffer engine: walks every address clearing the RAM after reset,
+    // then moves the cursor pixel with one read-modify-write per byte
+    // (erase at the drawn position, draw at the new one), one port access
+    // per cycle
+    localparam [2:0]
+        FB_CLEAR      = 3'd0,
+        FB_IDLE       = 3'd1,
+        FB_ERASE_READ = 3'd2,
+        FB_ERASE      = 3'd3,
+        FB_DRAW_READ  = 3'd4,
+        FB_DRAW       = 3'd5;
+    reg [2:0] fb_state;
+    reg [FB_ADDR_BITS-1:0] fb_clear_addr;
+    reg fb_drawn;    // A cursor pixel is set at fb_drawn_x/y
+    reg [15:0] fb_drawn_x;
+    reg [15:0] fb_drawn_y;
+    reg [15:0] fb_x;    // Position being drawn, latched from pixel_x/y
+    reg [15:0] fb_y;
+    wire [FB_ADDR_BITS-1:0] fb_drawn_idx = (fb_drawn_y >> 3) * OLED_WIDTH + fb_drawn_x;
+    wire [FB_ADDR_BITS-1:0] fb_idx = (fb_y >> 3) * OLED_WIDTH + fb_x;
+    
+    assign fb_we = (fb_state == FB_CLEAR) || (fb_state == FB_ERASE) || (fb_state == FB_DRAW);
+    assign fb_addr = (fb_state == FB_CLEAR) ? fb_clear_addr :
+                     (fb_state == FB_ERASE_READ || fb_state == FB_ERASE) ? fb_drawn_idx : fb_idx;
+    assign fb_wdata = (fb_state == FB_CLEAR) ? 8'h00 :
+                      (fb_state == FB_ERASE) ? fb_rdata & ~(8'd1 << fb_drawn_y[2:0]) :
+                                               fb_rdata | (8'd1 << fb_y[2:0]);
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            fb_state <= FB_CLEAR;
+            fb_clear_addr <= 0;
+            fb_drawn <= 1'b0;
+            fb_drawn_x <= 16'd0;
+            fb_drawn_y <= 16'd0;
+            fb_x <= 16'd0;
+            fb_y <= 16'd0;
+        end else begin
+            case (fb_state)
+                FB_CLEAR: begin
+                    fb_clear_addr <= fb_clear_addr + 1;
+                    if (fb_clear_addr == FB_BYTES - 1) begin
+                        fb_state <= FB_IDLE;
+                    end
+                end
+                
+                FB_IDLE: begin
+                    if (!fb_drawn || pixel_x != fb_drawn_x || pixel_y != fb_drawn_y) begin
+                        fb_x <= pixel_x;
+                        fb_y <= pixel_y;
+                        fb_state <= fb_drawn ? FB_ERASE_READ : FB_DRAW_READ;
+                    end
+                end
+                
+                FB_ERASE_READ: fb_state <= FB_ERASE;
+                FB_ERASE:      fb_state <= FB_DRAW_READ;
+                FB_DRAW_READ:  fb_state <= FB_DRAW;
+                
+                FB_DRAW: begin
+                    fb_drawn <= 1'b1;
+                    fb_drawn_x <= fb_x;
+                    fb_drawn_y <= fb_y;
+                    fb_state <= FB_IDLE;
+                end
+                
+                default: begin
+                    fb_state <= FB_IDLE;
+                end
+            endcase
+        end
+    end
+
+    // ============================================
+    // I2C Interface Logic
+    // ============================================
+
+    // I2C State Definitions
+    localparam [2:0]
+        I2C_IDLE      = 3'd0,
+        I2C_START     = 3'd1,
+        I2C_ADDR      = 3'd2,
+        I2C_DATA      = 3'd3,
+        I2C_STOP      = 3'd4;
+    
+    // I2C clock enable for 100kHz (assuming 50MHz system clock)
+    assign i2c_clk_enable = (i2c_clk_div == 9'd249);
+    
+    // I2C clock divider
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            i2c_clk_div <= 9'd0;
+        end else begin
+            if (i2c_clk_div == 9'd499) begin
+                i2c_clk_div <= 9'd0;
+            end else begin
+                i2c_clk_div <= i2c_clk_div + 9'd1;
+            end
+        end
+    end
+    
+    // I2C state machine
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            i2c_state <= I2C_IDLE;
+            i2c_bit_counter <= 3'd7;
+            i2c_write_active <= 1'b0;
+            i2c_address <= 7'h3C;
+            i2c_data_out <= 8'h00;
+        end else if (i2c_clk_enable) begin
+            case (i2c_state)
+                I2C_IDLE: begin
+                    if (i2c_write_active) begin
+                        i2c_state <= I2C_START;
+                    end
+                end
+                
+                I2C_START: begin
+                    i2c_state <= I2C_ADDR;
+                end
+                
+                I2C_ADDR: begin
+                    if (i2c_bit_counter == 3'd0) begin
+                        i2c_state <= I2C_DATA;
+                        i2c_bit_counter <= 3'd7;
+                    end else begin
+                        i2c_bit_counter <= i2c_bit_counter - 3'd1;
+                    end
+                end
+                
+                I2C_DATA: begin
+                    if (i2c_bit_counter == 3'd0) begin
+                        i2c_state <= I2C_STOP;
+                    end else begin
+                        i2c_bit_counter <= i2c_bit_counter - 3'd1;
+                    end
+                end
+                
+                I2C_STOP: begin
+                    i2c_state <= I2C_IDLE;
+                    i2c_write_active <= 1'b0;
+                end
+                
+                default: begin
+                    i2c_state <= I2C_IDLE;
+                end
+            endcase
+        end
+    end
+    
+    // I2C output signal generation
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            // I2C idle high
+            SDA <= 1'b1;
+            SCL <= 1'b1;
+        end else if (i2c_clk_enable) begin
+            case (i2c_state)
+                I2C_IDLE: begin
+                    // SCL and SDA remain high (idle state)
+                end
+                
+                I2C_START: begin
+                    // Start condition: SDA goes low while SCL is high
+                    SDA <= 1'b0;
+                end
+                
+                I2C_ADDR: begin
+                    // Generate clock pulse and output address bit
+                    SCL <= ~SCL;  // Toggle SCL
+                    if (!SCL) begin  // On falling edge of SCL
+                        SDA <= i2c_address[i2c_bit_counter];
+                    end
+                end
+                
+                I2C_DATA: begin
+                    // Generate clock pulse and output data bit
+                    SCL <= ~SCL;
+                    if (!SCL) begin  // On falling edge of SCL
+                        SDA <= i2c_data_out[i2c_bit_counter];
+                    end
+                end
+                
+                I2C_STOP: begin
+                    // Stop condition: SDA goes high while SCL is high
+                    SCL <= 1'b0;
+                    SDA <= 1'b0;
+                    SCL <= 1'b1;
+                    SDA <= 1'b1;
+                end
+            endcase
+        end
+    end
+
+    // Outputs with no generated logic, held at their idle level
+    assign LED = 1'b0;
+
+endmodule
+
+// ============================================================
+// Framebuffer RAM: port A read/write, port B read-only, both synchronous
+// with one cycle read latency and no reset, so it infers block RAM
+// ============================================================
+module oled_cursor_framebuffer #(
+    parameter WIDTH = 8,
+    parameter DEPTH = 1024,
+    parameter ADDR_BITS = 10,
+    parameter DUAL_PORT = 1         // 0: single port, b_rdata reads as zero
+) (
+    input wire clk,
+    input wire a_we,
+    input wire [ADDR_BITS-1:0] a_addr,
+    input wire [WIDTH-1:0] a_wdata,
+    output reg [WIDTH-1:0] a_rdata,
+    input wire [ADDR_BITS-1:0] b_addr,
+    output reg [WIDTH-1:0] b_rdata
+);
+    reg [WIDTH-1:0] mem [0:DEPTH-1];
+    
+    always @(posedge clk) begin
+        if (a_we) begin
+            mem[a_addr] <= a_wdata;
+        end
+        a_rdata <= mem[a_addr];
+    end
+    
+    generate
+        if (DUAL_PORT) begin : scan_port
+            always @(posedge clk) begin
+                b_rdata <= mem[b_addr];
+            end
+        end else begin : no_scan_port
+            always @(posedge clk) begin
+                b_rdata <= {WIDTH{1'b0}};
+            end
+        end
+    endgenerate
+endmodule
\ No newline at end of file
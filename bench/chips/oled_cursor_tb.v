@@ -0,0 +1,120 @@
+`timescale 1ns / 1ps
+// ============================================================
+// Self-checking testbench for oled_cursor
+// Generated by Perfected Wokwi2Verilog Converter
+// Run length: +cycles=N (default 11000); prints PASS or FAIL
+// ============================================================
+module oled_cursor_tb;
+    parameter CLK_HZ = 1000000;
+    
+    reg clk = 1'b0;
+    reg rst_n = 1'b0;
+    integer cycles = 0;
+    integer limit = 11000;
+    integer errors = 0;
+    integer hold;
+    
+    parameter FB_DUAL_PORT = 1;     // Framebuffer RAM build, -P/-G to override
+    integer i;
+    integer set_bytes;
+    
+    // Inputs at their idle levels
+    reg Up = 1'b1;
+    reg Down = 1'b1;
+    reg Left = 1'b1;
+    reg Right = 1'b1;
+    
+    // Outputs
+    wire SDA;
+    wire SCL;
+    wire LED;
+    
+    oled_cursor #(
+        .CLK_HZ(CLK_HZ),
+        .FB_DUAL_PORT(FB_DUAL_PORT)
+    ) dut (
+        .clk(clk),
+        .rst_n(rst_n),
+        .SDA(SDA),
+        .SCL(SCL),
+        .Up(Up),
+        .Down(Down),
+        .Left(Left),
+        .Right(Right),
+        .LED(LED)
+    );
+    
+    always #5 clk = ~clk;
+    
+    always @(posedge clk) begin
+        cycles <= cycles + 1;
+    end
+    
+    task check(input ok, input [8*64-1:0] what);
+        begin
+            if (!ok) begin
+                errors = errors + 1;
+                $display("FAIL at cycle %0d: %0s", cycles, what);
+            end
+        end
+    endtask
+    
+    initial begin
+        if ($value$plusargs("cycles=%d", limit)) begin
+            $display("Running %0d cycles", limit);
+        end
+        hold = limit / 10;
+        if (hold < 1100) hold = 1100;      // Longer than the 100 us debounce
+        repeat (4) @(posedge clk);
+        rst_n = 1'b1;
+        @(posedge clk);
+        #1;
+        
+        // Out of reset
+        
+        // Stimulus: inputs pressed and released in turn
+        repeat (hold) @(posedge clk);
+        Up = 1'b0;
+        repeat (hold) @(posedge clk);
+        check(dut.Up_debounced === 1'b0, "Up press seen after debounce");
+        Up = 1'b1;
+        repeat (hold) @(posedge clk);
+        Down = 1'b0;
+        repeat (hold) @(posedge clk);
+        check(dut.Down_debounced === 1'b0, "Down press seen after debounce");
+        Down = 1'b1;
+        repeat (hold) @(posedge clk);
+        Left = 1'b0;
+        repeat (hold) @(posedge clk);
+        check(dut.Left_debounced === 1'b0, "Left press seen after debounce");
+        Left = 1'b1;
+        repeat (hold) @(posedge clk);
+        Right = 1'b0;
+        repeat (hold) @(posedge clk);
+        check(dut.Right_debounced === 1'b0, "Right press seen after debounce");
+        Right = 1'b1;
+        repeat (hold) @(posedge clk);
+        check(dut.Up_debounced === 1'b1, "Up release seen after debounce");
+        check(dut.Down_debounced === 1'b1, "Down release seen after debounce");
+        check(dut.Left_debounced === 1'b1, "Left release seen after debounce");
+        check(dut.Right_debounced === 1'b1, "Right release seen after debounce");
+        wait (cycles >= limit);
+        #1;
+        
+        // After the run
+        check(dut.pixel_x == 127 && dut.pixel_y == 63, "cursor at (127, 63)");
+        check(dut.framebuffer.mem[1023] === 8'h80, "cursor pixel drawn in byte 1023");
+        set_bytes = 0;
+        for (i = 0; i < 1024; i = i + 1) begin
+            if (dut.framebuffer.mem[i] !== 8'h00) set_bytes = set_bytes + 1;
+        end
+        check(set_bytes == 1, "old cursor pixels erased");
+        
+        if (errors == 0) begin
+            $display("PASS oled_cursor: %0d cycles", cycles);
+        end else begin
+            $display("FAIL oled_cursor: %0d errors", errors);
+        end
+        $finish;
+    end
+endmodule
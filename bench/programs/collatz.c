@@ -0,0 +1,14 @@
+// Longest Collatz chain for starting values 1..30
+best = 0;
+start = 1;
+while (start <= 30) {
+    x = start;
+    steps = 0;
+    while (x != 1) {
+        if (x / 2 * 2 == x) x = x / 2; else x = x * 3 + 1;
+        steps = steps + 1;
+    }
+    if (steps > best) best = steps;
+    start = start + 1;
+}
+print(best);
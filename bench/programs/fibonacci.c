@@ -0,0 +1,12 @@
+// Fibonacci numbers below 10000, printed every fifth term
+a = 0;
+b = 1;
+n = 0;
+while (b < 10000) {
+    t = a + b;
+    a = b;
+    b = t;
+    n = n + 1;
+    if (n - (n / 5 * 5) == 0) print(b);
+}
+print(n);
@@ -0,0 +1,12 @@
+// 30x30 multiplication table checksum
+total = 0;
+row = 1;
+while (row <= 30) {
+    col = 1;
+    while (col <= 30) {
+        total = total + (row * col / 10);
+        col = col + 1;
+    }
+    row = row + 1;
+}
+print(total);
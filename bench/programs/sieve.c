@@ -0,0 +1,16 @@
+// Count the primes below 200 with a sieve
+composite[200];
+count = 0;
+i = 2;
+while (i < 200) {
+    if (composite[i] == 0) {
+        count = count + 1;
+        j = i * i;
+        while (j < 200) {
+            composite[j] = 1;
+            j = j + i;
+        }
+    }
+    i = i + 1;
+}
+print(count);
@@ -0,0 +1,11 @@
+// Sum of 1..100 and of the even numbers below 100
+i = 0;
+sum = 0;
+even = 0;
+while (i < 100) {
+    i = i + 1;
+    sum = sum + i;
+    if (i / 2 * 2 == i) even = even + i;
+}
+print(sum);
+print(even);
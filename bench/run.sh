@@ -0,0 +1,28 @@
+#!/bin/sh
+# Compare VM dispatch strategies on the sample programs
+# Usage: bench/run.sh [program.c...]   (CC and CFLAGS are honoured)
+
+set -e
+cd "$(dirname "$0")"
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+OUT=${TMPDIR:-/tmp}/vm_bench.$$
+trap 'rm -f "$OUT"-*' EXIT
+
+if [ $# -eq 0 ]; then
+    set -- programs/*.c
+fi
+
+for variant in \
+    "threaded-super:" \
+    "threaded-plain:-DVM_SUPERINSTRUCTIONS=0" \
+    "switch-super:-DVM_SWITCH_DISPATCH" \
+    "switch-plain:-DVM_SWITCH_DISPATCH -DVM_SUPERINSTRUCTIONS=0"
+do
+    name=${variant%%:*}
+    flags=${variant#*:}
+    $CC $CFLAGS $flags -I. -o "$OUT-$name" vm_bench.c
+    "$OUT-$name" "$@"
+    echo
+done
@@ -0,0 +1,87 @@
+#!/bin/sh
+# Convert chips with their testbenches, simulate them and report speed
+# Usage: bench/sim.sh [chip.c|directory|glob...]   (default: example.c)
+# SIM=verilator|iverilog picks the simulator (default: whichever is found),
+# CYCLES=N overrides each testbench's run length,
+# PARAMS="NAME=VALUE ..." overrides testbench parameters (e.g. FB_DUAL_PORT=0)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${TMPDIR:-/tmp}/wokwi_sim.$$
+trap 'rm -rf "$OUT"' EXIT
+
+if [ $# -eq 0 ]; then
+    set -- "$ROOT/example.c"
+fi
+
+if [ -z "$SIM" ]; then
+    if command -v verilator >/dev/null 2>&1; then
+        SIM=verilator
+    elif command -v iverilog >/dev/null 2>&1; then
+        SIM=iverilog
+    else
+        echo "Neither verilator nor iverilog found" >&2
+        exit 1
+    fi
+fi
+
+python3 "$ROOT/wokwi2verilog.py" "$@" --out-dir "$OUT" --testbench --no-cache
+
+PLUSARGS=
+if [ -n "$CYCLES" ]; then
+    PLUSARGS="+cycles=$CYCLES"
+fi
+
+cd "$OUT"
+failed=0
+for tb in *_tb.v; do
+    module=${tb%_tb.v}
+    overrides=
+    for param in $PARAMS; do
+        case $SIM in
+            verilator) overrides="$overrides -G$param" ;;
+            iverilog) overrides="$overrides -P${module}_tb.$param" ;;
+        esac
+    done
+    case $SIM in
+        verilator)
+            # --timing runs the testbench's delays and waits; lint and style
+            # warnings are reported, a multiply driven or undriven signal fails
+            verilator --binary --timing -Wall -Wno-fatal \
+                -Werror-MULTIDRIVEN -Werror-UNDRIVEN $overrides \
+                --top-module "${module}_tb" --Mdir "obj_$module" -o sim \
+                "$module.v" "$tb" >"$module.build.log" 2>&1 \
+                || { echo "✗ $module: build failed"; cat "$module.build.log"; failed=1; continue; }
+            run="./obj_$module/sim"
+            ;;
+        iverilog)
+            iverilog -g2012 -s "${module}_tb" $overrides -o "$module.vvp" "$module.v" "$tb" \
+                || { echo "✗ $module: build failed"; failed=1; continue; }
+            run="vvp -n $module.vvp"
+            ;;
+        *)
+            echo "Unknown SIM=$SIM" >&2
+            exit 1
+            ;;
+    esac
+
+    # $readmemh images are found relative to the output directory
+    start=$(date +%s.%N)
+    $run $PLUSARGS >"$module.log" 2>&1 || true
+    end=$(date +%s.%N)
+
+    if grep -q "^PASS $module:" "$module.log"; then
+        awk -v s="$start" -v e="$end" -v m="$module" -v sim="$SIM" '
+            /^PASS / { cycles = $3 }
+            END {
+                secs = e - s
+                printf "✓ %s: %d cycles in %.2f s, %.0f cycles/s (%s)\n", m, cycles, secs, cycles / secs, sim
+            }' "$module.log"
+    else
+        echo "✗ $module: testbench failed"
+        cat "$module.log"
+        failed=1
+    fi
+done
+
+exit $failed
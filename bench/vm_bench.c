@@ -0,0 +1,78 @@
+// Host benchmark for the program.c bytecode VM in example.c
+// Usage: vm_bench program.c...   (see run.sh for the dispatch comparison)
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+// Keep the chip's console and UART output out of the timings
+#define OUTPUT_UART 0
+static int quiet_printf(const char *fmt, ...) { (void)fmt; return 0; }
+#define printf quiet_printf
+#include "../example.c"
+#undef printf
+
+#define BENCH_SECONDS 0.5
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int load_source(chip_state_t *chip, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 0;
+    }
+    size_t len = fread(chip->program_buffer, 1, sizeof(chip->program_buffer) - 1, f);
+    chip->program_buffer[len] = '\0';
+    fclose(f);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    static chip_state_t chip;
+    
+    printf("dispatch: %s, superinstructions: %s\n",
+           VM_THREADED ? "threaded" : "switch",
+           VM_SUPERINSTRUCTIONS ? "on" : "off");
+    
+    for (int i = 1; i < argc; i++) {
+        if (!load_source(&chip, argv[i])) return 1;
+        
+        chip.error = 0;
+        compile_program(&chip);
+        if (chip.error) {
+            printf("%-28s compile error: %s\n", argv[i], chip.error_msg);
+            continue;
+        }
+        
+        unsigned long runs = 0;
+        unsigned long long insns = 0;
+        double start = now_seconds();
+        double elapsed;
+        
+        do {
+            for (int v = 0; v < chip.var_count; v++) chip.variables[v].value = 0;
+            memset(chip.array_arena, 0, sizeof(chip.array_arena));
+            chip.pc = 0;
+            chip.sp = 0;
+            chip.loop_count = 0;
+            chip.exec_steps = 0;
+            chip.output_total = 0;
+            chip.running = 1;
+            while (!run_program_slice(&chip));
+            insns += chip.exec_steps;
+            runs++;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_SECONDS);
+        
+        printf("%-28s %4u insns %7lu insns/run %8.1f Minsn/s %9.2f us/run%s\n",
+               argv[i], chip.code_len, (unsigned long)chip.exec_steps,
+               insns / elapsed / 1e6, elapsed * 1e6 / runs,
+               chip.error ? " (error)" : "");
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+// Minimal host stand-in for the Wokwi chip API, used by vm_bench.c only.
+// Pins read as idle and timers never fire; the benchmark drives the VM directly.
+
+#ifndef WOKWI_API_H
+#define WOKWI_API_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// The chip API's timer_t clashes with the POSIX one
+#define timer_t wokwi_timer_t
+
+typedef int32_t pin_t;
+#define NO_PIN ((pin_t)-1)
+typedef uint32_t timer_t;
+typedef uint32_t uart_dev_t;
+
+enum { LOW = 0, HIGH = 1 };
+enum { INPUT = 0, OUTPUT = 1, INPUT_PULLUP = 2, INPUT_PULLDOWN = 3, ANALOG = 4 };
+enum { RISING = 1, FALLING = 2, BOTH = 3 };
+
+typedef struct {
+    void *user_data;
+    uint32_t edge;
+    void (*pin_change)(void *user_data, pin_t pin, uint32_t value);
+} pin_watch_config_t;
+
+typedef struct {
+    void *user_data;
+    void (*callback)(void *user_data);
+} timer_config_t;
+
+typedef struct {
+    void *user_data;
+    pin_t rx;
+    pin_t tx;
+    uint32_t baud_rate;
+    void (*rx_data)(void *user_data, uint8_t byte);
+    void (*write_done)(void *user_data);
+    uint32_t reserved[8];
+} uart_config_t;
+
+static inline pin_t pin_init(const char *name, uint32_t mode) { (void)name; (void)mode; return 0; }
+static inline void pin_write(pin_t pin, uint32_t value) { (void)pin; (void)value; }
+static inline uint32_t pin_read(pin_t pin) { (void)pin; return 1; }
+static inline bool pin_watch(pin_t pin, const pin_watch_config_t *config) { (void)pin; (void)config; return true; }
+static inline void pin_watch_stop(pin_t pin) { (void)pin; }
+static inline timer_t timer_init(const timer_config_t *config) { (void)config; return 0; }
+static inline void timer_start(timer_t timer, uint32_t micros, bool repeat) { (void)timer; (void)micros; (void)repeat; }
+static inline void timer_stop(timer_t timer) { (void)timer; }
+static inline uint64_t get_sim_nanos(void) { return 0; }
+static inline uint32_t attr_init(const char *name, uint32_t default_value) { (void)name; return default_value; }
+static inline uart_dev_t uart_init(const uart_config_t *config) { (void)config; return 0; }
+static inline bool uart_write(uart_dev_t uart, uint8_t *buffer, uint32_t count) { (void)uart; (void)buffer; (void)count; return true; }
+
+#endif
@@ -8,11 +8,158 @@
 #include <stdint.h>
 
 // Simple C interpreter structures
+#define MAX_CODE      512   // Bytecode instructions per program
+#define VM_STACK_SIZE 16    // Expression stack depth
+#define MAX_NESTING   8     // Nested if/while blocks
+#define ARRAY_ARENA   256   // Array elements shared by all arrays
+
+// VM build options: computed-goto dispatch where the compiler supports it
+// (define VM_SWITCH_DISPATCH to force the switch loop), and fusion of
+// common instruction sequences (define VM_SUPERINSTRUCTIONS=0 to disable)
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+#ifndef VM_SUPERINSTRUCTIONS
+#define VM_SUPERINSTRUCTIONS 1
+#endif
+
+// Per-statement profiler (define VM_PROFILE=1): the compiler then marks
+// each statement with OP_STMT and a report is printed after every run.
+// Nothing is emitted or compiled in when it is off. Statements are timed
+// on the host clock; simulated time does not move inside an exec slice.
+#ifndef VM_PROFILE
+#define VM_PROFILE 0
+#endif
+#if VM_PROFILE
+#include <time.h>
+#endif
+#define MAX_PROFILED_STATEMENTS 64
+
+// Width of variables and program values (16 or 32 bits). Arithmetic that
+// does not fit is reported as an error instead of wrapping.
+#ifndef VM_VALUE_BITS
+#define VM_VALUE_BITS 32
+#endif
+
+#if VM_VALUE_BITS == 32
+typedef int32_t value_t;
+#define VALUE_MIN INT32_MIN
+#define VALUE_MAX INT32_MAX
+#else
+typedef int16_t value_t;
+#define VALUE_MIN INT16_MIN
+#define VALUE_MAX INT16_MAX
+#endif
+
+// Overflow-checked arithmetic on value_t, true when the result does not fit
+#if defined(__GNUC__)
+#define VALUE_ADD_OVERFLOW(a, b, r) __builtin_add_overflow(a, b, r)
+#define VALUE_SUB_OVERFLOW(a, b, r) __builtin_sub_overflow(a, b, r)
+#define VALUE_MUL_OVERFLOW(a, b, r) __builtin_mul_overflow(a, b, r)
+#else
+static inline int value_fit(int64_t v, value_t *r) {
+    *r = (value_t)v;
+    return v < VALUE_MIN || v > VALUE_MAX;
+}
+#define VALUE_ADD_OVERFLOW(a, b, r) value_fit((int64_t)(a) + (b), r)
+#define VALUE_SUB_OVERFLOW(a, b, r) value_fit((int64_t)(a) - (b), r)
+#define VALUE_MUL_OVERFLOW(a, b, r) value_fit((int64_t)(a) * (b), r)
+#endif
+
+// Program output is kept as compact records in a ring buffer and only
+// formatted when shown; OUTPUT_UART=1 also streams it out on UART_TX
+#define OUTPUT_RING_SIZE 256   // Power of two
+#define OUTPUT_UART_BAUD 115200
+
+#ifndef OUTPUT_UART
+#define OUTPUT_UART 1
+#endif
+
 typedef struct {
     char name[16];
-    int16_t value;
+    value_t value;
+    uint16_t array_base;    // First element in array_arena
+    uint16_t array_len;     // 0 for plain variables
 } variable_t;
 
+typedef struct {
+    uint8_t op;
+    uint8_t var;    // Variable slot for OP_LOAD/OP_STORE and array ops
+    uint8_t var2;   // Destination slot for OP_STORE_ADD_CONST
+    int32_t arg;    // Constant or jump target
+} insn_t;
+
+enum {
+    OUT_PRINT,      // print(value)
+    OUT_ASSIGN,     // variables[var] = value
+    OUT_ASSIGN_INDEX,   // variables[var][index] = value
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t var;
+    uint16_t index;
+    int32_t value;
+} output_record_t;
+
+#if VM_PROFILE
+typedef struct {
+    uint16_t source_pos;    // Offset of the statement in program_buffer
+    uint32_t count;         // Times executed
+    uint32_t insns;         // Instructions executed inside it
+    uint64_t host_ns;       // Host time spent inside it
+} stmt_profile_t;
+#endif
+
+// Display panel: controller init sequence plus the geometry and memory
+// access mode it is driven in
+typedef struct {
+    const char *name;
+    uint16_t width;         // In the selected orientation
+    uint16_t height;
+    uint8_t madctl;         // Memory access control (orientation, RGB/BGR)
+    uint8_t pixel_format;   // COLMOD parameter
+    const uint8_t *init;    // Init sequence, see INIT_DELAY
+    uint16_t init_len;
+} panel_t;
+
+// Timers are created once in chip_init and reused for the whole session
+typedef enum {
+    TIMER_INIT,             // Boot delay before the SD card is read
+    TIMER_DISPLAY_INIT,     // Next step of the display init sequence
+    TIMER_INPUT_DEBOUNCE,   // Armed by SD_CD / RUN_BTN edges
+    TIMER_RENDER,           // Deferred render of a dirty screen
+    TIMER_PROGRAM,          // One program slice per tick while running
+    TIMER_COUNT
+} timer_id_t;
+
+typedef struct {
+    void (*callback)(void *user_data);
+    uint32_t period_us;
+    uint8_t periodic;       // Re-fires every period_us until stopped
+} timer_def_t;
+
+// Final state of the last completed run, keyed by a hash of its source;
+// the source itself is kept so a hash collision is never replayed
+typedef struct {
+    uint8_t valid;
+    uint32_t hash;
+    uint16_t length;
+    char source[4096];      // Copy of program_buffer
+    variable_t variables[32];
+    uint8_t var_count;
+    value_t array_arena[ARRAY_ARENA];
+    uint16_t arena_used;
+    output_record_t outputs[OUTPUT_RING_SIZE];
+    uint32_t output_total;
+    value_t output_value;
+    uint8_t error;
+    char error_msg[64];
+} result_cache_t;
+
 typedef struct {
     // Display pins
     pin_t VCC;
@@ -37,32 +184,72 @@ typedef struct {
     
     // Button state tracking
     uint8_t btn_pressed;
-    uint8_t btn_debounce;
     
     // Program state
     uint8_t running;
+    uint8_t run_requested;  // Run queue: one pending run at most
     uint8_t error;
     char error_msg[64];
-    int16_t output_value;
+    value_t output_value;
     
     // Interpreter state
     variable_t variables[32];
     uint8_t var_count;
+    value_t array_arena[ARRAY_ARENA];   // Elements of all declared arrays
+    uint16_t arena_used;
     char program_buffer[4096];
     uint8_t program_loaded;
-    
-    // Output display
-    char program_outputs[10][32];
-    uint8_t output_count;
+    uint32_t program_hash;
+    uint16_t program_length;
+    
+    // Compiled program and VM state (saved between slices)
+    insn_t program_code[MAX_CODE];
+    uint16_t code_len;
+    uint16_t code_label;    // Last jump target, fusion never crosses it
+    uint16_t pc;
+    uint8_t sp;
+    value_t stack[VM_STACK_SIZE];
+    uint32_t loop_count;
+    uint32_t exec_steps;    // Instructions executed so far
+    
+#if VM_PROFILE
+    stmt_profile_t profile[MAX_PROFILED_STATEMENTS];
+    uint8_t profile_count;
+    uint8_t profile_current;    // Statement being executed
+    uint32_t profile_steps;     // exec_steps when it started
+    uint64_t profile_ns;        // Host time when it started
+#endif
+    
+    // Program output (last OUTPUT_RING_SIZE records of output_total)
+    output_record_t outputs[OUTPUT_RING_SIZE];
+    uint32_t output_total;
+    
+    // Output stream
+    pin_t UART_TX;
+    uart_dev_t uart;
+    uint32_t uart_next;     // Next output record to send
+    uint8_t uart_busy;
+    char uart_line[48];
+    
+    // Programs have no inputs, so a rerun of the same source is replayed
+    result_cache_t cache;
     
     // SD card state
     uint8_t sd_initialized;
     uint8_t sd_card_present;
     
-    timer_t timer;
-    timer_t display_timer;
-    timer_t btn_debounce_timer;
-    timer_t program_timer;
+    // Display panel and its init sequence
+    const panel_t *panel;
+    uint16_t display_init_pos;  // Offset into panel->init
+    uint8_t display_ready;      // Init sequence done, renders allowed
+    
+    // Render scheduler
+    uint8_t render_dirty;       // Screen no longer matches the state
+    uint8_t render_pending;     // TIMER_RENDER is armed
+    uint64_t render_next_ns;    // Earliest time for the next render
+    
+    timer_t timers[TIMER_COUNT];
+    const timer_def_t *timer_defs;
 } chip_state_t;
 
 // Colors
@@ -271,10 +458,91 @@ static const uint8_t font_5x7[][7] = {
 };
 
 
+// ===========================================
+// TIMER POOL
+// ===========================================
+
+static void timer_pool_init(chip_state_t *chip, const timer_def_t *defs) {
+    chip->timer_defs = defs;
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        const timer_config_t config = {
+            .callback = defs[i].callback,
+            .user_data = chip,
+        };
+        chip->timers[i] = timer_init(&config);
+    }
+}
+
+// (Re)arm a timer with its configured period
+static void timer_pool_start(chip_state_t *chip, timer_id_t id) {
+    const timer_def_t *def = &chip->timer_defs[id];
+    timer_start(chip->timers[id], def->period_us, def->periodic);
+}
+
+// Arm a one-shot timer with an explicit delay
+static void timer_pool_start_in(chip_state_t *chip, timer_id_t id, uint32_t micros) {
+    timer_start(chip->timers[id], micros, 0);
+}
+
+static void timer_pool_stop(chip_state_t *chip, timer_id_t id) {
+    timer_stop(chip->timers[id]);
+}
+
+
 // ===========================================
 // DISPLAY FUNCTIONS
 // ===========================================
 
+// Init sequences are byte streams of steps
+//     cmd, flags, <flags & INIT_LEN_MASK parameter bytes>, [delay ms]
+// INIT_DELAY adds the trailing delay byte, INIT_PSEUDO makes cmd one of
+// the INIT_OP_* operations below instead of a controller command. Delays
+// are the datasheet minimums.
+#define INIT_LEN_MASK 0x3F
+#define INIT_PSEUDO   0x40
+#define INIT_DELAY    0x80
+
+enum {
+    INIT_OP_RST_LOW,        // Drive RST
+    INIT_OP_RST_HIGH,
+    INIT_OP_PIXEL_FORMAT,   // COLMOD with panel->pixel_format
+    INIT_OP_MADCTL,         // MADCTL with panel->madctl
+};
+
+static const uint8_t ili9341_init[] = {
+    INIT_OP_RST_LOW,      INIT_PSEUDO | INIT_DELAY, 1,
+    INIT_OP_RST_HIGH,     INIT_PSEUDO | INIT_DELAY, 5,
+    0x01,                 INIT_DELAY, 120,          // Software reset, 120 ms before sleep out
+    0x11,                 INIT_DELAY, 5,            // Sleep out
+    INIT_OP_PIXEL_FORMAT, INIT_PSEUDO,
+    INIT_OP_MADCTL,       INIT_PSEUDO,
+    0x29,                 0,                        // Display on
+};
+
+static const uint8_t st7789_init[] = {
+    INIT_OP_RST_LOW,      INIT_PSEUDO | INIT_DELAY, 1,
+    INIT_OP_RST_HIGH,     INIT_PSEUDO | INIT_DELAY, 5,
+    0x01,                 INIT_DELAY, 120,          // Software reset, 120 ms before sleep out
+    0x11,                 INIT_DELAY, 5,            // Sleep out
+    INIT_OP_PIXEL_FORMAT, INIT_PSEUDO,
+    INIT_OP_MADCTL,       INIT_PSEUDO,
+    0x21,                 0,                        // Inversion on (IPS panels)
+    0x13,                 0,                        // Normal display mode
+    0x29,                 0,                        // Display on
+};
+
+#define PANEL_INIT(seq) seq, sizeof(seq)
+
+// Selected with the "panel" chip attribute
+static const panel_t panels[] = {
+    { "ILI9341",           240, 320, 0x48, 0x55, PANEL_INIT(ili9341_init) },  // MX | BGR
+    { "ILI9341 landscape", 320, 240, 0x28, 0x55, PANEL_INIT(ili9341_init) },  // MV | BGR
+    { "ST7789",            240, 320, 0x00, 0x55, PANEL_INIT(st7789_init) },
+    { "ST7789 landscape",  320, 240, 0x60, 0x55, PANEL_INIT(st7789_init) },   // MX | MV
+};
+
+#define PANEL_COUNT (sizeof(panels) / sizeof(panels[0]))
+
 static void spi_write(pin_t mosi, pin_t sck, uint8_t data) {
     for (int i = 7; i >= 0; i--) {
         pin_write(mosi, (data >> i) & 1);
@@ -322,9 +590,12 @@ static void set_window(chip_state_t *chip, uint16_t x0, uint16_t y0, uint16_t x1
 }
 
 static void fill_rect(chip_state_t *chip, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color) {
-    if (x >= 240 || y >= 320) return;
-    if (x + w > 240) w = 240 - x;
-    if (y + h > 320) h = 320 - y;
+    uint16_t width = chip->panel->width;
+    uint16_t height = chip->panel->height;
+    
+    if (x >= width || y >= height) return;
+    if (x + w > width) w = width - x;
+    if (y + h > height) h = height - y;
     
     set_window(chip, x, y, x + w - 1, y + h - 1);
     send_cmd(chip, 0x2C);
@@ -355,7 +626,7 @@ static void draw_string(chip_state_t *chip, const char *str, uint16_t x, uint16_
     while (*str) {
         draw_char(chip, *str, cx, y, color);
         cx += FONT_WIDTH + 1;
-        if (cx + FONT_WIDTH > 240) {
+        if (cx + FONT_WIDTH > chip->panel->width) {
             cx = x;
             y += FONT_HEIGHT + 2;
         }
@@ -550,6 +821,40 @@ static uint8_t read_file(chip_state_t *chip, const char *filename, char *buffer,
 // C INTERPRETER FUNCTIONS
 // ===========================================
 
+// Character classes for the scanner
+#define CC_DIGIT    0x01
+#define CC_ALPHA    0x02
+#define CC_IDENT    0x04
+#define CC_SPACE    0x08
+#define CC_OPERATOR 0x10
+
+#define CHAR_CLASS(c) ( \
+    ((c) >= '0' && (c) <= '9' ? CC_DIGIT | CC_IDENT : 0) | \
+    (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') ? CC_ALPHA | CC_IDENT : 0) | \
+    ((c) == '_' ? CC_IDENT : 0) | \
+    ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r' ? CC_SPACE : 0) | \
+    ((c) == '+' || (c) == '-' || (c) == '*' || (c) == '/' ? CC_OPERATOR : 0))
+
+#define CHAR_CLASS_ROW(r) \
+    CHAR_CLASS((r) + 0x0), CHAR_CLASS((r) + 0x1), CHAR_CLASS((r) + 0x2), CHAR_CLASS((r) + 0x3), \
+    CHAR_CLASS((r) + 0x4), CHAR_CLASS((r) + 0x5), CHAR_CLASS((r) + 0x6), CHAR_CLASS((r) + 0x7), \
+    CHAR_CLASS((r) + 0x8), CHAR_CLASS((r) + 0x9), CHAR_CLASS((r) + 0xA), CHAR_CLASS((r) + 0xB), \
+    CHAR_CLASS((r) + 0xC), CHAR_CLASS((r) + 0xD), CHAR_CLASS((r) + 0xE), CHAR_CLASS((r) + 0xF)
+
+// 256-entry class table, built by the preprocessor (one lookup per character)
+static const uint8_t char_class[256] = {
+    CHAR_CLASS_ROW(0x00), CHAR_CLASS_ROW(0x10), CHAR_CLASS_ROW(0x20), CHAR_CLASS_ROW(0x30),
+    CHAR_CLASS_ROW(0x40), CHAR_CLASS_ROW(0x50), CHAR_CLASS_ROW(0x60), CHAR_CLASS_ROW(0x70),
+    CHAR_CLASS_ROW(0x80), CHAR_CLASS_ROW(0x90), CHAR_CLASS_ROW(0xA0), CHAR_CLASS_ROW(0xB0),
+    CHAR_CLASS_ROW(0xC0), CHAR_CLASS_ROW(0xD0), CHAR_CLASS_ROW(0xE0), CHAR_CLASS_ROW(0xF0),
+};
+
+#define IS_DIGIT(c)    (char_class[(uint8_t)(c)] & CC_DIGIT)
+#define IS_ALPHA(c)    (char_class[(uint8_t)(c)] & CC_ALPHA)
+#define IS_IDENT(c)    (char_class[(uint8_t)(c)] & CC_IDENT)
+#define IS_SPACE(c)    (char_class[(uint8_t)(c)] & CC_SPACE)
+#define IS_OPERATOR(c) (char_class[(uint8_t)(c)] & CC_OPERATOR)
+
 // Find or create variable
 static variable_t* get_variable(chip_state_t *chip, const char *name) {
     for (int i = 0; i < chip->var_count; i++) {
@@ -561,6 +866,8 @@ static variable_t* get_variable(chip_state_t *chip, const char *name) {
     if (chip->var_count < 32) {
         strcpy(chip->variables[chip->var_count].name, name);
         chip->variables[chip->var_count].value = 0;
+        chip->variables[chip->var_count].array_base = 0;
+        chip->variables[chip->var_count].array_len = 0;
         chip->var_count++;
         return &chip->variables[chip->var_count - 1];
     }
@@ -568,11 +875,13 @@ static variable_t* get_variable(chip_state_t *chip, const char *name) {
     return NULL;
 }
 
-// Parse integer from string
-static int parse_number(const char **str) {
-    int result = 0;
-    while (**str >= '0' && **str <= '9') {
-        result = result * 10 + (**str - '0');
+// Parse integer from string (saturates just above INT32_MAX)
+static int64_t parse_number(const char **str) {
+    int64_t result = 0;
+    while (IS_DIGIT(**str)) {
+        if (result <= INT32_MAX) {
+            result = result * 10 + (**str - '0');
+        }
         (*str)++;
     }
     return result;
@@ -581,10 +890,7 @@ static int parse_number(const char **str) {
 // Parse identifier from string
 static void parse_identifier(const char **str, char *buf, int max_len) {
     int i = 0;
-    while ((**str >= 'a' && **str <= 'z') || 
-           (**str >= 'A' && **str <= 'Z') ||
-           (**str >= '0' && **str <= '9') ||
-           **str == '_') {
+    while (IS_IDENT(**str)) {
         if (i < max_len - 1) {
             buf[i++] = **str;
         }
@@ -595,179 +901,479 @@ static void parse_identifier(const char **str, char *buf, int max_len) {
 
 // Skip whitespace
 static void skip_whitespace(const char **str) {
-    while (**str == ' ' || **str == '\t' || **str == '\n' || **str == '\r') {
+    while (IS_SPACE(**str)) {
         (*str)++;
     }
 }
 
-// Evaluate expression (handles +, -, *, /, numbers, and variables)
-static int eval_expression(chip_state_t *chip, const char **str) {
+// Bytecode operations
+enum {
+    OP_HALT,
+    OP_CONST,       // push arg
+    OP_LOAD,        // push variables[var]
+    OP_STORE,       // variables[var] = pop
+    OP_LOAD_INDEX,  // top = variables[var][top]
+    OP_STORE_INDEX, // value = pop, variables[var][pop] = value
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_PRINT,       // print pop
+    OP_JUMP,        // pc = arg
+    OP_JUMP_FALSE,  // if (!pop) pc = arg
+    OP_LOOP,        // pc = arg, backward branch counted against LOOP_LIMIT
+    OP_STMT,        // Profiler mark: statement arg starts
+    
+    // Superinstructions (fused by emit)
+    OP_LOAD_CONST,      // push variables[var], push arg
+    OP_ADD_CONST,       // top += arg
+    OP_LOAD_ADD_CONST,  // push variables[var] + arg
+    OP_STORE_ADD_CONST, // variables[var2] = variables[var] + arg
+    OP_JUMP_EQ,         // compare + OP_JUMP_FALSE: jump unless a cond b
+    OP_JUMP_NE,
+    OP_JUMP_LT,
+    OP_JUMP_LE,
+    OP_JUMP_GT,
+    OP_JUMP_GE,
+    
+    OP_COUNT
+};
+
+// Skip whitespace and // comments
+static void skip_blank(const char **str) {
+    while (1) {
+        skip_whitespace(str);
+        if ((*str)[0] != '/' || (*str)[1] != '/') {
+            return;
+        }
+        while (**str && **str != '\n') (*str)++;
+    }
+}
+
+// Consume keyword if it is the next whole identifier
+static uint8_t match_keyword(const char **str, const char *keyword) {
+    size_t len = strlen(keyword);
+    if (strncmp(*str, keyword, len) != 0 || IS_IDENT((*str)[len])) {
+        return 0;
+    }
+    *str += len;
+    return 1;
+}
+
+// Consume expected character or report "Expected <c>"
+static uint8_t expect_char(chip_state_t *chip, const char **str, char c) {
+    skip_whitespace(str);
+    if (**str != c) {
+        chip->error = 1;
+        sprintf(chip->error_msg, "Expected %c", c);
+        return 0;
+    }
+    (*str)++;
+    return 1;
+}
+
+#if VM_SUPERINSTRUCTIONS
+// Merge op into the previous instruction where a superinstruction exists
+static uint8_t fuse(chip_state_t *chip, uint8_t op, uint8_t var, int arg) {
+    if (chip->code_len == 0 || chip->code_len - 1 < chip->code_label) {
+        return 0;
+    }
+    
+    insn_t *prev = &chip->program_code[chip->code_len - 1];
+    
+    switch (op) {
+        case OP_CONST:
+            if (prev->op == OP_LOAD) {
+                prev->op = OP_LOAD_CONST;
+                prev->arg = arg;
+                return 1;
+            }
+            break;
+        case OP_ADD:
+        case OP_SUB:
+            if (prev->op == OP_LOAD_CONST || prev->op == OP_CONST) {
+                prev->op = (prev->op == OP_CONST) ? OP_ADD_CONST : OP_LOAD_ADD_CONST;
+                if (op == OP_SUB) prev->arg = -prev->arg;
+                return 1;
+            }
+            break;
+        case OP_STORE:
+            if (prev->op == OP_LOAD_ADD_CONST) {
+                prev->op = OP_STORE_ADD_CONST;
+                prev->var2 = var;
+                return 1;
+            }
+            break;
+        case OP_JUMP_FALSE:
+            // Jump when the comparison is false, i.e. on the inverse condition
+            switch (prev->op) {
+                case OP_EQ: prev->op = OP_JUMP_NE; break;
+                case OP_NE: prev->op = OP_JUMP_EQ; break;
+                case OP_LT: prev->op = OP_JUMP_GE; break;
+                case OP_LE: prev->op = OP_JUMP_GT; break;
+                case OP_GT: prev->op = OP_JUMP_LE; break;
+                case OP_GE: prev->op = OP_JUMP_LT; break;
+                default: return 0;
+            }
+            prev->arg = arg;
+            return 1;
+    }
+    return 0;
+}
+#endif
+
+// Append one instruction, returns its address
+static uint16_t emit(chip_state_t *chip, uint8_t op, uint8_t var, int arg) {
+#if VM_SUPERINSTRUCTIONS
+    if (fuse(chip, op, var, arg)) {
+        return chip->code_len - 1;
+    }
+#endif
+    
+    if (chip->code_len >= MAX_CODE) {
+        if (!chip->error) {
+            chip->error = 1;
+            strcpy(chip->error_msg, "Program too large");
+        }
+        return 0;
+    }
+    
+    insn_t *insn = &chip->program_code[chip->code_len];
+    insn->op = op;
+    insn->var = var;
+    insn->var2 = 0;
+    insn->arg = arg;
+    return chip->code_len++;
+}
+
+// Point a forward jump at the next instruction
+static void patch_jump(chip_state_t *chip, uint16_t at) {
+    chip->program_code[at].arg = chip->code_len;
+    chip->code_label = chip->code_len;
+}
+
+static void compile_expression(chip_state_t *chip, const char **str, uint8_t depth);
+
+// Compile a number, variable or parenthesized expression
+static void compile_term(chip_state_t *chip, const char **str, uint8_t depth, const char *error_msg) {
     skip_whitespace(str);
     
-    int result = 0;
+    if (depth >= VM_STACK_SIZE) {
+        chip->error = 1;
+        strcpy(chip->error_msg, "Expression too complex");
+        return;
+    }
     
-    // Parse first term
-    if (**str >= '0' && **str <= '9') {
-        result = parse_number(str);
-    } else if ((**str >= 'a' && **str <= 'z') || (**str >= 'A' && **str <= 'Z')) {
+    if (IS_DIGIT(**str)) {
+        int64_t value = parse_number(str);
+        if (value > VALUE_MAX) {
+            chip->error = 1;
+            strcpy(chip->error_msg, "Number too large");
+            return;
+        }
+        emit(chip, OP_CONST, 0, value);
+    } else if (IS_ALPHA(**str)) {
         char var_name[16];
         parse_identifier(str, var_name, sizeof(var_name));
         variable_t *var = get_variable(chip, var_name);
-        result = var ? var->value : 0;
-    } else if (**str == '(') {
-        (*str)++;
-        result = eval_expression(chip, str);
+        if (!var) {
+            chip->error = 1;
+            strcpy(chip->error_msg, "Too many variables");
+            return;
+        }
+        
         skip_whitespace(str);
-        if (**str == ')') (*str)++;
-        else {
+        if (**str == '[') {
+            if (!var->array_len) {
+                chip->error = 1;
+                snprintf(chip->error_msg, sizeof(chip->error_msg), "Not an array: %s", var_name);
+                return;
+            }
+            (*str)++;
+            // The index replaces itself on the stack, only recursion adds depth
+            compile_expression(chip, str, depth + 1);
+            if (chip->error || !expect_char(chip, str, ']')) return;
+            emit(chip, OP_LOAD_INDEX, var - chip->variables, 0);
+        } else if (var->array_len) {
             chip->error = 1;
-            strcpy(chip->error_msg, "Expected )");
-            return 0;
+            snprintf(chip->error_msg, sizeof(chip->error_msg), "Missing index: %s", var_name);
+        } else {
+            emit(chip, OP_LOAD, var - chip->variables, 0);
+        }
+    } else if (**str == '(') {
+        (*str)++;
+        // Parentheses count as a level too, which bounds compiler recursion
+        compile_expression(chip, str, depth + 1);
+        if (!chip->error) {
+            expect_char(chip, str, ')');
         }
     } else {
         chip->error = 1;
-        strcpy(chip->error_msg, "Invalid expression start");
-        return 0;
+        strcpy(chip->error_msg, error_msg);
     }
+}
+
+// Compile +, -, *, / chain (evaluated left to right)
+static void compile_arithmetic(chip_state_t *chip, const char **str, uint8_t depth) {
+    compile_term(chip, str, depth, "Invalid expression start");
     
-    // Handle operators
-    while (1) {
+    while (!chip->error) {
         skip_whitespace(str);
         
         char op = **str;
-        if (op != '+' && op != '-' && op != '*' && op != '/') {
+        if (!IS_OPERATOR(op)) {
             break;
         }
         (*str)++;
         
-        skip_whitespace(str);
-        
-        int next_value = 0;
-        
-        // Parse next term
-        if (**str >= '0' && **str <= '9') {
-            next_value = parse_number(str);
-        } else if ((**str >= 'a' && **str <= 'z') || (**str >= 'A' && **str <= 'Z')) {
-            char var_name[16];
-            parse_identifier(str, var_name, sizeof(var_name));
-            variable_t *var = get_variable(chip, var_name);
-            next_value = var ? var->value : 0;
-        } else if (**str == '(') {
-            (*str)++;
-            next_value = eval_expression(chip, str);
-            skip_whitespace(str);
-            if (**str == ')') (*str)++;
-            else {
-                chip->error = 1;
-                strcpy(chip->error_msg, "Expected )");
-                return 0;
-            }
-        } else {
-            chip->error = 1;
-            strcpy(chip->error_msg, "Expected value after operator");
-            return 0;
-        }
+        compile_term(chip, str, depth + 1, "Expected value after operator");
         
-        // Apply operator
         switch (op) {
-            case '+': result += next_value; break;
-            case '-': result -= next_value; break;
-            case '*': result *= next_value; break;
-            case '/': 
-                if (next_value != 0) {
-                    result /= next_value;
-                } else {
-                    chip->error = 1;
-                    strcpy(chip->error_msg, "Division by zero");
-                    return 0;
-                }
-                break;
+            case '+': emit(chip, OP_ADD, 0, 0); break;
+            case '-': emit(chip, OP_SUB, 0, 0); break;
+            case '*': emit(chip, OP_MUL, 0, 0); break;
+            case '/': emit(chip, OP_DIV, 0, 0); break;
         }
     }
+}
+
+// Compile expression with an optional comparison (==, !=, <, <=, >, >=)
+static void compile_expression(chip_state_t *chip, const char **str, uint8_t depth) {
+    compile_arithmetic(chip, str, depth);
+    if (chip->error) {
+        return;
+    }
     
-    return result;
+    skip_whitespace(str);
+    
+    const char *s = *str;
+    uint8_t op;
+    if (s[0] == '=' && s[1] == '=') op = OP_EQ;
+    else if (s[0] == '!' && s[1] == '=') op = OP_NE;
+    else if (s[0] == '<' && s[1] == '=') op = OP_LE;
+    else if (s[0] == '>' && s[1] == '=') op = OP_GE;
+    else if (s[0] == '<') op = OP_LT;
+    else if (s[0] == '>') op = OP_GT;
+    else return;
+    
+    *str += (op == OP_LT || op == OP_GT) ? 1 : 2;
+    
+    compile_arithmetic(chip, str, depth + 1);
+    emit(chip, op, 0, 0);
+}
+
+// True when "size];" follows, i.e. a statement after '[' declares an array
+static int is_array_size(const char *p) {
+    while (*p == ' ' || *p == '\t') p++;
+    if (!IS_DIGIT(*p)) return 0;
+    while (IS_DIGIT(*p)) p++;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p++ != ']') return 0;
+    while (*p == ' ' || *p == '\t') p++;
+    return *p == ';';
 }
 
-// Run a single C statement
-static void run_statement(chip_state_t *chip, const char **program) {
+// Array declaration "name[size];", the name and '[' are already consumed.
+// Elements are carved out of array_arena and start out as zero. Declaring
+// an existing array again with the same size leaves it as it is.
+static void compile_array_declaration(chip_state_t *chip, const char **program, variable_t *var) {
     skip_whitespace(program);
+    if (!IS_DIGIT(**program)) {
+        chip->error = 1;
+        snprintf(chip->error_msg, sizeof(chip->error_msg), "Not an array: %s", var->name);
+        return;
+    }
+    
+    int64_t size = parse_number(program);
+    if (var->array_len) {
+        if (size != var->array_len) {
+            chip->error = 1;
+            snprintf(chip->error_msg, sizeof(chip->error_msg), "Array size changed: %s", var->name);
+            return;
+        }
+        if (expect_char(chip, program, ']')) {
+            expect_char(chip, program, ';');
+        }
+        return;
+    }
+    if (size == 0) {
+        chip->error = 1;
+        strcpy(chip->error_msg, "Array size must be positive");
+        return;
+    }
+    if (size > ARRAY_ARENA - chip->arena_used) {
+        chip->error = 1;
+        strcpy(chip->error_msg, "Out of array memory");
+        return;
+    }
+    if (!expect_char(chip, program, ']') || !expect_char(chip, program, ';')) return;
+    
+    var->array_base = chip->arena_used;
+    var->array_len = size;
+    chip->arena_used += size;
+}
+
+static void compile_statement(chip_state_t *chip, const char **program, uint8_t nesting);
+
+// Compile a { } block or a single statement
+static void compile_block(chip_state_t *chip, const char **program, uint8_t nesting) {
+    skip_blank(program);
+    
+    if (**program != '{') {
+        compile_statement(chip, program, nesting);
+        return;
+    }
+    (*program)++;
+    
+    while (!chip->error) {
+        skip_blank(program);
+        if (**program == '}') {
+            (*program)++;
+            return;
+        }
+        if (**program == '\0') {
+            chip->error = 1;
+            strcpy(chip->error_msg, "Expected }");
+            return;
+        }
+        compile_statement(chip, program, nesting);
+    }
+}
+
+// Compile a single C statement
+static void compile_statement(chip_state_t *chip, const char **program, uint8_t nesting) {
+    skip_blank(program);
     
     // End of program
     if (**program == '\0') {
         return;
     }
     
-    // Comment
-    if (strncmp(*program, "//", 2) == 0) {
-        while (**program && **program != '\n') (*program)++;
-        if (**program == '\n') (*program)++;
+    if (nesting > MAX_NESTING) {
+        chip->error = 1;
+        strcpy(chip->error_msg, "Nesting too deep");
         return;
     }
     
+    uint16_t stmt_start = chip->code_len;
+    
+#if VM_PROFILE
+    if (chip->profile_count < MAX_PROFILED_STATEMENTS) {
+        stmt_profile_t *prof = &chip->profile[chip->profile_count];
+        memset(prof, 0, sizeof(*prof));
+        prof->source_pos = *program - chip->program_buffer;
+        emit(chip, OP_STMT, 0, chip->profile_count++);
+    }
+#endif
+    
     // Print statement
-    if (strncmp(*program, "print(", 6) == 0) {
-        *program += 6; // Skip "print("
+    if (match_keyword(program, "print")) {
+        if (!expect_char(chip, program, '(')) return;
+        compile_expression(chip, program, 0);
+        if (chip->error || !expect_char(chip, program, ')')) return;
+        emit(chip, OP_PRINT, 0, 0);
+        expect_char(chip, program, ';');
+        return;
+    }
+    
+    // if (cond) block [else block]
+    if (match_keyword(program, "if")) {
+        if (!expect_char(chip, program, '(')) return;
+        compile_expression(chip, program, 0);
+        if (chip->error || !expect_char(chip, program, ')')) return;
         
-        int value = eval_expression(chip, program);
-        chip->output_value = value;
+        uint16_t skip_then = emit(chip, OP_JUMP_FALSE, 0, 0);
+        compile_block(chip, program, nesting + 1);
+        if (chip->error) return;
         
-        // Store output for display
-        if (chip->output_count < 10) {
-            sprintf(chip->program_outputs[chip->output_count], "OUT: %d", value);
-            chip->output_count++;
+        skip_blank(program);
+        if (match_keyword(program, "else")) {
+            uint16_t skip_else = emit(chip, OP_JUMP, 0, 0);
+            patch_jump(chip, skip_then);
+            compile_block(chip, program, nesting + 1);
+            patch_jump(chip, skip_else);
+        } else {
+            patch_jump(chip, skip_then);
         }
+        return;
+    }
+    
+    // while (cond) block
+    if (match_keyword(program, "while")) {
+        // Loop back to the statement mark so the profiler counts each test
+        uint16_t loop_start = stmt_start;
+        chip->code_label = loop_start;
         
-        printf("PROGRAM OUTPUT: %d\n", value);
-        
-        skip_whitespace(program);
-        if (**program != ')') {
-            chip->error = 1;
-            strcpy(chip->error_msg, "Expected )");
-            return;
-        }
-        (*program)++;
+        if (!expect_char(chip, program, '(')) return;
+        compile_expression(chip, program, 0);
+        if (chip->error || !expect_char(chip, program, ')')) return;
         
-        skip_whitespace(program);
-        if (**program != ';') {
-            chip->error = 1;
-            strcpy(chip->error_msg, "Expected ;");
-        } else {
-            (*program)++;
-        }
+        uint16_t exit_jump = emit(chip, OP_JUMP_FALSE, 0, 0);
+        compile_block(chip, program, nesting + 1);
+        emit(chip, OP_LOOP, 0, loop_start);
+        patch_jump(chip, exit_jump);
+        return;
+    }
+    
+    if (match_keyword(program, "else")) {
+        chip->error = 1;
+        strcpy(chip->error_msg, "else without if");
         return;
     }
     
     // Variable assignment
-    if ((**program >= 'a' && **program <= 'z') || (**program >= 'A' && **program <= 'Z')) {
+    if (IS_ALPHA(**program)) {
         char var_name[16];
         parse_identifier(program, var_name, sizeof(var_name));
         
-        skip_whitespace(program);
-        if (**program != '=') {
+        uint8_t known = chip->var_count;
+        variable_t *var = get_variable(chip, var_name);
+        if (!var) {
             chip->error = 1;
-            strcpy(chip->error_msg, "Expected =");
+            strcpy(chip->error_msg, "Too many variables");
             return;
         }
-        (*program)++;
-        
-        int value = eval_expression(chip, program);
-        variable_t *var = get_variable(chip, var_name);
-        if (var) {
-            var->value = value;
-            // Store output for display
-            if (chip->output_count < 10) {
-                sprintf(chip->program_outputs[chip->output_count], "%s = %d", var_name, value);
-                chip->output_count++;
-            }
-        }
         
         skip_whitespace(program);
-        if (**program != ';') {
-            chip->error = 1;
-            strcpy(chip->error_msg, "Expected ;");
-        } else {
+        if (**program == '[') {
             (*program)++;
+            if (!var->array_len && var - chip->variables < known) {
+                // Already used as a plain variable, its value would be lost
+                chip->error = 1;
+                snprintf(chip->error_msg, sizeof(chip->error_msg), "Not an array: %s", var_name);
+                return;
+            }
+            if (!var->array_len || is_array_size(*program)) {
+                compile_array_declaration(chip, program, var);
+                return;
+            }
+            
+            // Element assignment: index stays on the stack under the value
+            compile_expression(chip, program, 0);
+            if (chip->error || !expect_char(chip, program, ']')) return;
+            if (!expect_char(chip, program, '=')) return;
+            compile_expression(chip, program, 1);
+            if (chip->error) return;
+            emit(chip, OP_STORE_INDEX, var - chip->variables, 0);
+        } else {
+            if (var->array_len) {
+                chip->error = 1;
+                snprintf(chip->error_msg, sizeof(chip->error_msg), "Missing index: %s", var_name);
+                return;
+            }
+            if (!expect_char(chip, program, '=')) return;
+            compile_expression(chip, program, 0);
+            if (chip->error) return;
+            emit(chip, OP_STORE, var - chip->variables, 0);
         }
+        
+        expect_char(chip, program, ';');
         return;
     }
     
@@ -778,13 +1384,93 @@ static void run_statement(chip_state_t *chip, const char **program) {
     }
     
     chip->error = 1;
-    if (**program) {
-        sprintf(chip->error_msg, "Unexpected: '%c'", **program);
+    sprintf(chip->error_msg, "Unexpected: '%c'", **program);
+}
+
+// Compile program_buffer into program_code
+static void compile_program(chip_state_t *chip) {
+    const char *ptr = chip->program_buffer;
+    
+    chip->code_len = 0;
+    chip->code_label = 0;
+#if VM_PROFILE
+    chip->profile_count = 0;
+#endif
+    chip->var_count = 0;
+    chip->arena_used = 0;
+    
+    while (*ptr && !chip->error) {
+        compile_statement(chip, &ptr, 0);
+    }
+    emit(chip, OP_HALT, 0, 0);
+}
+
+// ===========================================
+// PROGRAM OUTPUT
+// ===========================================
+
+// Append an output record, overwriting the oldest once the ring is full
+static inline void record_output(chip_state_t *chip, uint8_t kind, uint8_t var, uint16_t index, value_t value) {
+    output_record_t *rec = &chip->outputs[chip->output_total & (OUTPUT_RING_SIZE - 1)];
+    rec->kind = kind;
+    rec->var = var;
+    rec->index = index;
+    rec->value = value;
+    chip->output_total++;
+}
+
+// Format an output record as text
+static void format_output(const chip_state_t *chip, const output_record_t *rec, char *buf, size_t size) {
+    if (rec->kind == OUT_PRINT) {
+        snprintf(buf, size, "OUT: %ld", (long)rec->value);
+    } else if (rec->kind == OUT_ASSIGN_INDEX) {
+        snprintf(buf, size, "%s[%u] = %ld", chip->variables[rec->var].name, (unsigned)rec->index, (long)rec->value);
     } else {
-        strcpy(chip->error_msg, "Unexpected end");
+        snprintf(buf, size, "%s = %ld", chip->variables[rec->var].name, (long)rec->value);
     }
 }
 
+#if OUTPUT_UART
+// Send the next print() record if the UART is idle
+static void uart_pump(chip_state_t *chip) {
+    if (chip->uart_busy) {
+        return;
+    }
+    
+    // Records that already left the ring are lost
+    if (chip->output_total - chip->uart_next > OUTPUT_RING_SIZE) {
+        chip->uart_next = chip->output_total - OUTPUT_RING_SIZE;
+    }
+    
+    // Only print() output is streamed, assignments stay on the display
+    while (chip->uart_next < chip->output_total) {
+        const output_record_t *rec = &chip->outputs[chip->uart_next & (OUTPUT_RING_SIZE - 1)];
+        chip->uart_next++;
+        if (rec->kind != OUT_PRINT) {
+            continue;
+        }
+        
+        int len = snprintf(chip->uart_line, sizeof(chip->uart_line), "%ld\r\n", (long)rec->value);
+        chip->uart_busy = uart_write(chip->uart, (uint8_t *)chip->uart_line, len);
+        return;
+    }
+}
+
+static void service_run_queue(chip_state_t *chip);
+
+static void uart_write_done(void *user_data) {
+    chip_state_t *chip = (chip_state_t*)user_data;
+    
+    chip->uart_busy = 0;
+    uart_pump(chip);
+    
+    // A queued run waits for the previous output to drain
+    if (!chip->uart_busy) {
+        service_run_queue(chip);
+    }
+}
+#endif
+
 // ===========================================
 // PROGRAM EXECUTION
 // ===========================================
@@ -827,7 +1513,65 @@ static void load_program_c(chip_state_t *chip) {
     chip->program_loaded = 1;
 }
 
-// Run program.c
+// Execution is cooperative: each program_timer tick runs at most
+// EXEC_SLICE_INSTRUCTIONS bytecode instructions and then yields
+#define EXEC_SLICE_INSTRUCTIONS 256
+#define EXEC_SLICE_US           1000
+#define LOOP_LIMIT              10000   // Backward branches per run
+
+// FNV-1a hash of the program source
+static uint32_t hash_program(const char *src, uint16_t *length) {
+    uint32_t hash = 2166136261u;
+    uint16_t len = 0;
+    while (src[len]) {
+        hash = (hash ^ (uint8_t)src[len]) * 16777619u;
+        len++;
+    }
+    *length = len;
+    return hash;
+}
+
+// Save the final state of a finished run
+static void store_cached_result(chip_state_t *chip) {
+    result_cache_t *cache = &chip->cache;
+    cache->hash = chip->program_hash;
+    cache->length = chip->program_length;
+    memcpy(cache->source, chip->program_buffer, chip->program_length);
+    memcpy(cache->variables, chip->variables, sizeof(cache->variables));
+    cache->var_count = chip->var_count;
+    memcpy(cache->array_arena, chip->array_arena, chip->arena_used * sizeof(value_t));
+    cache->arena_used = chip->arena_used;
+    memcpy(cache->outputs, chip->outputs, sizeof(cache->outputs));
+    cache->output_total = chip->output_total;
+    cache->output_value = chip->output_value;
+    cache->error = chip->error;
+    strcpy(cache->error_msg, chip->error_msg);
+    cache->valid = 1;
+}
+
+// Restore the cached run of the loaded program, returns 0 on a miss
+static uint8_t replay_cached_result(chip_state_t *chip) {
+    result_cache_t *cache = &chip->cache;
+    if (!cache->valid || cache->hash != chip->program_hash || cache->length != chip->program_length
+        || memcmp(cache->source, chip->program_buffer, chip->program_length) != 0) {
+        return 0;
+    }
+    
+    memcpy(chip->variables, cache->variables, sizeof(chip->variables));
+    chip->var_count = cache->var_count;
+    memcpy(chip->array_arena, cache->array_arena, cache->arena_used * sizeof(value_t));
+    chip->arena_used = cache->arena_used;
+    memcpy(chip->outputs, cache->outputs, sizeof(chip->outputs));
+    chip->output_total = cache->output_total;
+    chip->output_value = cache->output_value;
+    chip->error = cache->error;
+    strcpy(chip->error_msg, cache->error_msg);
+    return 1;
+}
+
+static void request_render(chip_state_t *chip);
+
+// Start program.c (bytecode runs in slices from program_timer)
 static void run_program_c(chip_state_t *chip) {
     printf("\n=== RUNNING program.c ===\n");
     
@@ -836,14 +1580,11 @@ static void run_program_c(chip_state_t *chip) {
     chip->error = 0;
     chip->output_value = 0;
     chip->var_count = 0;
-    chip->output_count = 0;
+    chip->output_total = 0;
+    chip->uart_next = 0;
+    chip->arena_used = 0;
     memset(chip->variables, 0, sizeof(chip->variables));
-    memset(chip->program_outputs, 0, sizeof(chip->program_outputs));
-    
-    // Clear screen for program execution
-    fill_rect(chip, 0, 0, 240, 320, COLOR_BLACK);
-    draw_string(chip, "EXECUTING PROGRAM.C", 30, 140, COLOR_YELLOW);
-    draw_string(chip, "Please wait...", 70, 160, COLOR_CYAN);
+    memset(chip->array_arena, 0, sizeof(chip->array_arena));
     
     // Load program from SD card
     load_program_c(chip);
@@ -852,23 +1593,405 @@ static void run_program_c(chip_state_t *chip) {
         chip->error = 1;
         strcpy(chip->error_msg, "Failed to load program");
         chip->running = 0;
+        request_render(chip);
+        return;
+    }
+    
+    chip->program_hash = hash_program(chip->program_buffer, &chip->program_length);
+    
+    // Same source as the last run: replay its result
+    if (replay_cached_result(chip)) {
+        printf("Program unchanged (hash %08lx), replaying cached result\n", (unsigned long)chip->program_hash);
+        if (chip->error) {
+            printf("ERROR: %s\n", chip->error_msg);
+        } else {
+            printf("Final output: %ld\n", (long)chip->output_value);
+        }
+        chip->running = 0;
+#if OUTPUT_UART
+        uart_pump(chip);
+#endif
+        request_render(chip);
+        return;
+    }
+    
+    compile_program(chip);
+    
+    if (chip->error) {
+        printf("COMPILE ERROR: %s\n", chip->error_msg);
+        store_cached_result(chip);
+        chip->running = 0;
+        request_render(chip);
         return;
     }
     
     // Execute program
-    const char *ptr = chip->program_buffer;
-    while (*ptr && !chip->error) {
-        run_statement(chip, &ptr);
+    chip->pc = 0;
+    chip->sp = 0;
+    chip->loop_count = 0;
+    chip->exec_steps = 0;
+#if VM_PROFILE
+    chip->profile_current = MAX_PROFILED_STATEMENTS;
+#endif
+    timer_pool_start(chip, TIMER_PROGRAM);
+    request_render(chip);
+}
+
+// Start the queued run if no program is running. This is the only place
+// that calls run_program_c, so at most one program runs at a time.
+static void service_run_queue(chip_state_t *chip) {
+    if (!chip->run_requested || chip->running) {
+        return;
+    }
+#if OUTPUT_UART
+    if (chip->uart_busy) {
+        return;
+    }
+#endif
+    
+    chip->run_requested = 0;
+    run_program_c(chip);
+}
+
+// Queue a run of program.c; requests made while one is already pending
+// are merged into it, and a run requested mid-program starts after it
+static void request_run(chip_state_t *chip, const char *source) {
+    if (chip->run_requested) {
+        printf("Run already queued (%s)\n", source);
+        return;
+    }
+    
+    printf("Run requested (%s)\n", source);
+    chip->run_requested = 1;
+    service_run_queue(chip);
+}
+
+#if VM_PROFILE
+static uint64_t host_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Close the running statement's counters and start the next one
+static void profile_mark(chip_state_t *chip, uint8_t next, uint32_t steps) {
+    uint64_t now = host_nanos();
+    
+    if (chip->profile_current < chip->profile_count) {
+        stmt_profile_t *prof = &chip->profile[chip->profile_current];
+        prof->insns += steps - chip->profile_steps;
+        prof->host_ns += now - chip->profile_ns;
+    }
+    
+    chip->profile_current = next;
+    chip->profile_steps = steps;
+    chip->profile_ns = now;
+    
+    if (next < chip->profile_count) {
+        chip->profile[next].count++;
+    }
+}
+
+// Print statements, most expensive first
+static void profile_report(chip_state_t *chip) {
+    uint8_t order[MAX_PROFILED_STATEMENTS];
+    uint8_t n = chip->profile_count;
+    
+    // Insertion sort by instructions executed
+    for (uint8_t i = 0; i < n; i++) {
+        uint8_t j = i;
+        while (j > 0 && chip->profile[order[j - 1]].insns < chip->profile[i].insns) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    
+    printf("\n=== PROFILE (%u statements) ===\n", n);
+    printf("LINE   COUNT     INSNS  HOST_US  STATEMENT\n");
+    
+    for (uint8_t i = 0; i < n; i++) {
+        const stmt_profile_t *prof = &chip->profile[order[i]];
+        const char *src = chip->program_buffer + prof->source_pos;
+        
+        int line = 1;
+        for (const char *c = chip->program_buffer; c < src; c++) {
+            if (*c == '\n') line++;
+        }
+        
+        char text[28];
+        int len = 0;
+        while (len < (int)sizeof(text) - 1 && src[len] && src[len] != '\n') {
+            text[len] = src[len];
+            len++;
+        }
+        text[len] = '\0';
+        
+        printf("%4d %7lu %9lu %8lu  %s\n", line, (unsigned long)prof->count,
+               (unsigned long)prof->insns, (unsigned long)(prof->host_ns / 1000), text);
+    }
+}
+#endif
+
+#if VM_THREADED
+#define VM_CASE(op) L_##op
+#define VM_NEXT() \
+    do { \
+        if (steps == budget) goto slice_end; \
+        steps++; \
+        insn = &code[pc++]; \
+        goto *dispatch_table[insn->op]; \
+    } while (0)
+#else
+#define VM_CASE(op) case op
+#define VM_NEXT() continue
+#endif
+
+#define VM_ARITH(op, overflow) \
+    VM_CASE(op): \
+        sp--; \
+        if (overflow(stack[sp - 1], stack[sp], &stack[sp - 1])) goto vm_overflow; \
+        VM_NEXT()
+
+#define VM_BINARY(op, expr) \
+    VM_CASE(op): \
+        sp--; \
+        stack[sp - 1] = (expr); \
+        VM_NEXT()
+
+#define VM_JUMP_IF(op, cond) \
+    VM_CASE(op): \
+        sp -= 2; \
+        if (stack[sp] cond stack[sp + 1]) pc = insn->arg; \
+        VM_NEXT()
+
+// Run one slice of the program, returns 1 once the program has finished
+static uint8_t run_program_slice(chip_state_t *chip) {
+    const insn_t *code = chip->program_code;
+    const insn_t *insn;
+    variable_t *vars = chip->variables;
+    value_t *stack = chip->stack;
+    uint16_t pc = chip->pc;
+    uint8_t sp = chip->sp;
+    uint8_t halted = 0;
+    int steps = 0;
+    int budget = EXEC_SLICE_INSTRUCTIONS;
+    
+#if OUTPUT_UART
+    // Each instruction records at most one output, so never run more
+    // instructions than there are unsent ring slots
+    uint32_t unsent = chip->output_total - chip->uart_next;
+    if (unsent > OUTPUT_RING_SIZE - EXEC_SLICE_INSTRUCTIONS) {
+        budget = OUTPUT_RING_SIZE - unsent;
+    }
+#endif
+    
+#if VM_THREADED
+    static const void *const dispatch_table[OP_COUNT] = {
+        [OP_HALT] = &&L_OP_HALT,
+        [OP_CONST] = &&L_OP_CONST,
+        [OP_LOAD] = &&L_OP_LOAD,
+        [OP_STORE] = &&L_OP_STORE,
+        [OP_LOAD_INDEX] = &&L_OP_LOAD_INDEX,
+        [OP_STORE_INDEX] = &&L_OP_STORE_INDEX,
+        [OP_ADD] = &&L_OP_ADD,
+        [OP_SUB] = &&L_OP_SUB,
+        [OP_MUL] = &&L_OP_MUL,
+        [OP_DIV] = &&L_OP_DIV,
+        [OP_EQ] = &&L_OP_EQ,
+        [OP_NE] = &&L_OP_NE,
+        [OP_LT] = &&L_OP_LT,
+        [OP_LE] = &&L_OP_LE,
+        [OP_GT] = &&L_OP_GT,
+        [OP_GE] = &&L_OP_GE,
+        [OP_PRINT] = &&L_OP_PRINT,
+        [OP_JUMP] = &&L_OP_JUMP,
+        [OP_JUMP_FALSE] = &&L_OP_JUMP_FALSE,
+        [OP_LOOP] = &&L_OP_LOOP,
+#if VM_PROFILE
+        [OP_STMT] = &&L_OP_STMT,
+#endif
+        [OP_LOAD_CONST] = &&L_OP_LOAD_CONST,
+        [OP_ADD_CONST] = &&L_OP_ADD_CONST,
+        [OP_LOAD_ADD_CONST] = &&L_OP_LOAD_ADD_CONST,
+        [OP_STORE_ADD_CONST] = &&L_OP_STORE_ADD_CONST,
+        [OP_JUMP_EQ] = &&L_OP_JUMP_EQ,
+        [OP_JUMP_NE] = &&L_OP_JUMP_NE,
+        [OP_JUMP_LT] = &&L_OP_JUMP_LT,
+        [OP_JUMP_LE] = &&L_OP_JUMP_LE,
+        [OP_JUMP_GT] = &&L_OP_JUMP_GT,
+        [OP_JUMP_GE] = &&L_OP_JUMP_GE,
+    };
+    
+    VM_NEXT();
+#else
+    while (steps < budget) {
+        steps++;
+        insn = &code[pc++];
+        
+        switch (insn->op) {
+#endif
+    
+    VM_CASE(OP_HALT):
+        halted = 1;
+        goto slice_end;
+    
+    VM_CASE(OP_CONST):
+        stack[sp++] = insn->arg;
+        VM_NEXT();
+    
+    VM_CASE(OP_LOAD):
+        stack[sp++] = vars[insn->var].value;
+        VM_NEXT();
+    
+    VM_CASE(OP_STORE):
+        sp--;
+        vars[insn->var].value = stack[sp];
+        record_output(chip, OUT_ASSIGN, insn->var, 0, stack[sp]);
+        VM_NEXT();
+    
+    VM_CASE(OP_LOAD_INDEX): {
+        const variable_t *array = &vars[insn->var];
+        value_t index = stack[sp - 1];
+        if (index < 0 || index >= array->array_len) goto vm_bounds;
+        stack[sp - 1] = chip->array_arena[array->array_base + index];
+        VM_NEXT();
+    }
+    
+    VM_CASE(OP_STORE_INDEX): {
+        const variable_t *array = &vars[insn->var];
+        sp -= 2;
+        value_t index = stack[sp];
+        if (index < 0 || index >= array->array_len) goto vm_bounds;
+        chip->array_arena[array->array_base + index] = stack[sp + 1];
+        record_output(chip, OUT_ASSIGN_INDEX, insn->var, index, stack[sp + 1]);
+        VM_NEXT();
+    }
+    
+    VM_ARITH(OP_ADD, VALUE_ADD_OVERFLOW);
+    VM_ARITH(OP_SUB, VALUE_SUB_OVERFLOW);
+    VM_ARITH(OP_MUL, VALUE_MUL_OVERFLOW);
+    
+    VM_CASE(OP_DIV):
+        sp--;
+        if (stack[sp] == 0) {
+            chip->error = 1;
+            strcpy(chip->error_msg, "Division by zero");
+            goto slice_end;
+        }
+        if (stack[sp - 1] == VALUE_MIN && stack[sp] == -1) goto vm_overflow;
+        stack[sp - 1] /= stack[sp];
+        VM_NEXT();
+    
+    VM_BINARY(OP_EQ, stack[sp - 1] == stack[sp]);
+    VM_BINARY(OP_NE, stack[sp - 1] != stack[sp]);
+    VM_BINARY(OP_LT, stack[sp - 1] < stack[sp]);
+    VM_BINARY(OP_LE, stack[sp - 1] <= stack[sp]);
+    VM_BINARY(OP_GT, stack[sp - 1] > stack[sp]);
+    VM_BINARY(OP_GE, stack[sp - 1] >= stack[sp]);
+    
+    VM_CASE(OP_PRINT): {
+        value_t value = stack[--sp];
+        chip->output_value = value;
+        record_output(chip, OUT_PRINT, 0, 0, value);
+#if !OUTPUT_UART
+        printf("PROGRAM OUTPUT: %ld\n", (long)value);
+#endif
+        VM_NEXT();
+    }
+    
+    VM_CASE(OP_JUMP):
+        pc = insn->arg;
+        VM_NEXT();
+    
+    VM_CASE(OP_JUMP_FALSE):
+        if (!stack[--sp]) pc = insn->arg;
+        VM_NEXT();
+    
+    VM_CASE(OP_LOOP):
+        if (++chip->loop_count > LOOP_LIMIT) {
+            chip->error = 1;
+            strcpy(chip->error_msg, "Loop limit exceeded");
+            goto slice_end;
+        }
+        pc = insn->arg;
+        VM_NEXT();
+    
+#if VM_PROFILE
+    VM_CASE(OP_STMT):
+        profile_mark(chip, insn->arg, chip->exec_steps + steps);
+        VM_NEXT();
+#endif
+    
+    VM_CASE(OP_LOAD_CONST):
+        stack[sp] = vars[insn->var].value;
+        stack[sp + 1] = insn->arg;
+        sp += 2;
+        VM_NEXT();
+    
+    VM_CASE(OP_ADD_CONST):
+        if (VALUE_ADD_OVERFLOW(stack[sp - 1], (value_t)insn->arg, &stack[sp - 1])) goto vm_overflow;
+        VM_NEXT();
+    
+    VM_CASE(OP_LOAD_ADD_CONST):
+        if (VALUE_ADD_OVERFLOW(vars[insn->var].value, (value_t)insn->arg, &stack[sp])) goto vm_overflow;
+        sp++;
+        VM_NEXT();
+    
+    VM_CASE(OP_STORE_ADD_CONST): {
+        value_t value;
+        if (VALUE_ADD_OVERFLOW(vars[insn->var].value, (value_t)insn->arg, &value)) goto vm_overflow;
+        vars[insn->var2].value = value;
+        record_output(chip, OUT_ASSIGN, insn->var2, 0, value);
+        VM_NEXT();
+    }
+    
+    VM_JUMP_IF(OP_JUMP_EQ, ==);
+    VM_JUMP_IF(OP_JUMP_NE, !=);
+    VM_JUMP_IF(OP_JUMP_LT, <);
+    VM_JUMP_IF(OP_JUMP_LE, <=);
+    VM_JUMP_IF(OP_JUMP_GT, >);
+    VM_JUMP_IF(OP_JUMP_GE, >=);
+    
+#if !VM_THREADED
+        }
+    }
+    goto slice_end;
+#endif
+    
+vm_overflow:
+    chip->error = 1;
+    strcpy(chip->error_msg, "Arithmetic overflow");
+    goto slice_end;
+    
+vm_bounds:
+    chip->error = 1;
+    strcpy(chip->error_msg, "Array index out of range");
+    
+slice_end:
+    chip->pc = pc;
+    chip->sp = sp;
+    chip->exec_steps += steps;
+    
+    if (!halted && !chip->error) {
+        return 0;
     }
     
     chip->running = 0;
+    store_cached_result(chip);
+    
+#if VM_PROFILE
+    profile_mark(chip, MAX_PROFILED_STATEMENTS, chip->exec_steps);
+    profile_report(chip);
+#endif
     
     if (chip->error) {
         printf("ERROR: %s\n", chip->error_msg);
     } else {
-        printf("Program finished successfully\n");
-        printf("Final output: %d\n", chip->output_value);
+        printf("Program finished successfully (%lu instructions)\n", (unsigned long)chip->exec_steps);
+        printf("Final output: %ld\n", (long)chip->output_value);
     }
+    return 1;
 }
 
 // ===========================================
@@ -876,12 +1999,29 @@ static void run_program_c(chip_state_t *chip) {
 // ===========================================
 
 static void update_display(chip_state_t *chip) {
+    uint16_t width = chip->panel->width;
+    uint16_t height = chip->panel->height;
+    uint16_t center_x = (width - 240) / 2;
+    
+    // Landscape moves the outputs to a right-hand column
+    uint8_t landscape = width > height;
+    uint16_t out_x = landscape ? 180 : 20;
+    uint16_t out_step = landscape ? 15 : 20;
+    uint16_t var_y = landscape ? 130 : 250;
+    
     // Clear screen
-    fill_rect(chip, 0, 0, 240, 320, COLOR_BLACK);
+    fill_rect(chip, 0, 0, width, height, COLOR_BLACK);
+    
+    // Program started but has nothing to show yet
+    if (chip->running && chip->output_total == 0) {
+        draw_string(chip, "EXECUTING PROGRAM.C", center_x + 30, height / 2 - 20, COLOR_YELLOW);
+        draw_string(chip, "Please wait...", center_x + 70, height / 2, COLOR_CYAN);
+        return;
+    }
     
     // Title
-    draw_string(chip, "C PROGRAM RUNNER", 50, 10, COLOR_GREEN);
-    draw_string(chip, "================", 50, 20, COLOR_CYAN);
+    draw_string(chip, "C PROGRAM RUNNER", center_x + 50, 10, COLOR_GREEN);
+    draw_string(chip, "================", center_x + 50, 20, COLOR_CYAN);
     
     // SD Card status
     if (chip->sd_card_present) {
@@ -904,179 +2044,195 @@ static void update_display(chip_state_t *chip) {
     }
     
     // Output section
-    draw_string(chip, "PROGRAM OUTPUTS:", 20, 130, COLOR_MAGENTA);
+    draw_string(chip, "PROGRAM OUTPUTS:", out_x, 130, COLOR_MAGENTA);
     
+    // Most recent outputs, oldest first
     int y_pos = 150;
-    for (int i = 0; i < chip->output_count && i < 6; i++) {
-        draw_string(chip, chip->program_outputs[i], 30, y_pos, COLOR_WHITE);
-        y_pos += 20;
+    uint32_t first = chip->output_total > 6 ? chip->output_total - 6 : 0;
+    for (uint32_t i = first; i < chip->output_total; i++) {
+        char line[32];
+        format_output(chip, &chip->outputs[i & (OUTPUT_RING_SIZE - 1)], line, sizeof(line));
+        draw_string(chip, line, out_x + 10, y_pos, COLOR_WHITE);
+        y_pos += out_step;
     }
     
-    if (chip->output_count == 0 && !chip->running) {
-        draw_string(chip, "No outputs yet", 30, 150, COLOR_GRAY);
+    if (chip->output_total == 0 && !chip->running) {
+        draw_string(chip, "No outputs yet", out_x + 10, 150, COLOR_GRAY);
     }
     
     // Variables section
-    draw_string(chip, "VARIABLES:", 20, 250, COLOR_CYAN);
+    draw_string(chip, "VARIABLES:", 20, var_y, COLOR_CYAN);
     
-    y_pos = 270;
+    y_pos = var_y + 20;
     for (int i = 0; i < chip->var_count && i < 3; i++) {
         char var_str[32];
-        sprintf(var_str, "%s = %d", chip->variables[i].name, chip->variables[i].value);
+        const variable_t *var = &chip->variables[i];
+        if (var->array_len) {
+            sprintf(var_str, "%s[%u]", var->name, (unsigned)var->array_len);
+        } else {
+            sprintf(var_str, "%s = %ld", var->name, (long)var->value);
+        }
         draw_string(chip, var_str, 30, y_pos, COLOR_YELLOW);
         y_pos += 15;
     }
     
     // Instructions
     if (!chip->running) {
-        draw_string(chip, "Press RUN_BTN to execute", 20, 310, COLOR_WHITE);
+        draw_string(chip, "Press RUN_BTN to execute", 20, height - 10, COLOR_WHITE);
     }
 }
 
-// ===========================================
-// TIMERS AND CALLBACKS
-// ===========================================
+// Renders are coalesced: any number of requests before TIMER_RENDER fires
+// produce one frame, and frames are at least RENDER_MIN_FRAME_US apart
+#define RENDER_MIN_FRAME_US 250000
 
-static void program_timer_callback(void *user_data) {
+static void request_render(chip_state_t *chip) {
+    chip->render_dirty = 1;
+    if (chip->render_pending || !chip->display_ready) {
+        return;
+    }
+    
+    uint64_t next = chip->render_next_ns;
+    uint64_t now = get_sim_nanos();
+    chip->render_pending = 1;
+    timer_pool_start_in(chip, TIMER_RENDER, next > now ? (next - now) / 1000 : 0);
+}
+
+static void render_timer_callback(void *user_data) {
     chip_state_t *chip = (chip_state_t*)user_data;
     
-    // Program execution finished, update display
-    chip->running = 0;
+    chip->render_pending = 0;
+    if (!chip->render_dirty) {
+        return;
+    }
+    
+    chip->render_dirty = 0;
+    chip->render_next_ns = get_sim_nanos() + RENDER_MIN_FRAME_US * 1000ULL;
     update_display(chip);
 }
 
-static void main_timer_callback(void *user_data) {
+// ===========================================
+// TIMERS AND CALLBACKS
+// ===========================================
+
+static void program_timer_callback(void *user_data) {
     chip_state_t *chip = (chip_state_t*)user_data;
     
-    // Check SD card presence
-    uint8_t sd_present = (pin_read(chip->SD_CD) == 0);
-    if (sd_present != chip->sd_card_present) {
-        chip->sd_card_present = sd_present;
-        if (!chip->running) {
-            update_display(chip);
-        }
+    if (!chip->running) {
+        timer_pool_stop(chip, TIMER_PROGRAM);
+        return;
     }
     
-    // Check RUN button
-    uint8_t btn_state = pin_read(chip->RUN_BTN);
+    uint32_t output_total = chip->output_total;
+    uint8_t finished = run_program_slice(chip);
     
-    if (btn_state == 0 && !chip->btn_pressed && !chip->btn_debounce && !chip->running) {
-        chip->btn_debounce = 1;
-        chip->btn_pressed = 1;
-        
-        printf("RUN button pressed - executing program\n");
-        
-        // Start program execution
-        run_program_c(chip);
-        
-        // Schedule display update after program finishes
-        const timer_config_t program_config = {
-            .callback = program_timer_callback,
-            .user_data = chip,
-        };
-        chip->program_timer = timer_init(&program_config);
-        timer_start(chip->program_timer, 100000, 1); // 100ms delay for display
-        
-        // Clear debounce after 50ms
-        const timer_config_t debounce_config = {
-            .callback = NULL,
-            .user_data = chip,
-        };
-        chip->btn_debounce_timer = timer_init(&debounce_config);
-        timer_start(chip->btn_debounce_timer, 50000, 1);
-    }
-    else if (btn_state == 1 && chip->btn_pressed) {
-        chip->btn_pressed = 0;
+#if OUTPUT_UART
+    uart_pump(chip);
+#endif
+    
+    if (finished) {
+        timer_pool_stop(chip, TIMER_PROGRAM);
+        service_run_queue(chip);
     }
     
-    timer_start(chip->timer, 50000, 0);
+    // New output or the final state to show
+    if (finished || chip->output_total != output_total) {
+        request_render(chip);
+    }
 }
 
-static void display_timer_callback(void *user_data) {
+#define INPUT_DEBOUNCE_US 50000
+
+// Inputs settled: act on whatever changed since the last settle
+static void input_debounce_callback(void *user_data) {
     chip_state_t *chip = (chip_state_t*)user_data;
     
-    // Clear debounce flag
-    if (chip->btn_debounce) {
-        chip->btn_debounce = 0;
+    // SD card inserted or removed
+    uint8_t sd_present = (pin_read(chip->SD_CD) == 0);
+    if (sd_present != chip->sd_card_present) {
+        chip->sd_card_present = sd_present;
+        // Card swapped or removed, the cached result may be stale
+        chip->cache.valid = 0;
+        request_render(chip);
     }
     
-    // Only update display if not running program
-    if (!chip->running) {
-        update_display(chip);
+    // RUN button
+    uint8_t btn_down = (pin_read(chip->RUN_BTN) == 0);
+    if (btn_down && !chip->btn_pressed) {
+        chip->btn_pressed = 1;
+        request_run(chip, "RUN button");
+    } else if (!btn_down) {
+        chip->btn_pressed = 0;
     }
-    
-    timer_start(chip->display_timer, 500000, 0); // Update every 500ms
 }
 
-static void run_btn_callback(void *user_data, pin_t pin, uint32_t value) {
+// Any edge on SD_CD or RUN_BTN (re)arms the debounce timer, the inputs
+// are only read once they have been stable for INPUT_DEBOUNCE_US
+static void input_change_callback(void *user_data, pin_t pin, uint32_t value) {
     chip_state_t *chip = (chip_state_t*)user_data;
-    
-    if (value == 0 && !chip->running && !chip->btn_debounce) {
-        chip->btn_debounce = 1;
-        printf("RUN button pressed via callback\n");
-        
-        // Start program
-        run_program_c(chip);
-        
-        // Schedule display update
-        const timer_config_t program_config = {
-            .callback = program_timer_callback,
-            .user_data = chip,
-        };
-        chip->program_timer = timer_init(&program_config);
-        timer_start(chip->program_timer, 100000, 1);
-        
-        // Clear debounce
-        const timer_config_t debounce_config = {
-            .callback = NULL,
-            .user_data = chip,
-        };
-        chip->btn_debounce_timer = timer_init(&debounce_config);
-        timer_start(chip->btn_debounce_timer, 50000, 1);
-    }
+    (void)pin;
+    (void)value;
+    timer_pool_start(chip, TIMER_INPUT_DEBOUNCE);
 }
 
 // ===========================================
 // INITIALIZATION
 // ===========================================
 
-static void init_display(chip_state_t *chip) {
-    printf("Initializing ILI9341...\n");
-    
-    // Hardware reset
-    pin_write(chip->RST, 0);
-    timer_t delay = timer_init(NULL);
-    timer_start(delay, 10000, 0);
-    
-    pin_write(chip->RST, 1);
-    timer_start(delay, 100000, 0);
-    
-    // Initialization sequence
-    send_cmd(chip, 0x01);  // Software reset
-    timer_start(delay, 5000, 0);
-    
-    send_cmd(chip, 0x11);  // Sleep out
-    timer_start(delay, 120000, 0);
-    
-    send_cmd(chip, 0x3A);  // Color mode
-    send_data(chip, 0x55); // 16-bit
-    
-    send_cmd(chip, 0x36);  // MADCTL
-    send_data(chip, 0x48); // Portrait
-    
-    send_cmd(chip, 0x29);  // Display on
+// Run the panel's init sequence up to the next delay, then continue
+// from TIMER_DISPLAY_INIT
+static void display_init_callback(void *user_data) {
+    chip_state_t *chip = (chip_state_t*)user_data;
+    const panel_t *panel = chip->panel;
+    
+    while (chip->display_init_pos < panel->init_len) {
+        const uint8_t *step = &panel->init[chip->display_init_pos];
+        uint8_t cmd = step[0];
+        uint8_t flags = step[1];
+        uint8_t len = flags & INIT_LEN_MASK;
+        const uint8_t *data = &step[2];
+        chip->display_init_pos += 2 + len + ((flags & INIT_DELAY) ? 1 : 0);
+        
+        if (!(flags & INIT_PSEUDO)) {
+            send_cmd(chip, cmd);
+            for (int i = 0; i < len; i++) {
+                send_data(chip, data[i]);
+            }
+        } else if (cmd == INIT_OP_RST_LOW || cmd == INIT_OP_RST_HIGH) {
+            pin_write(chip->RST, cmd == INIT_OP_RST_HIGH);
+        } else if (cmd == INIT_OP_PIXEL_FORMAT) {
+            send_cmd(chip, 0x3A);
+            send_data(chip, panel->pixel_format);
+        } else if (cmd == INIT_OP_MADCTL) {
+            send_cmd(chip, 0x36);
+            send_data(chip, panel->madctl);
+        }
+        
+        if (flags & INIT_DELAY) {
+            timer_pool_start_in(chip, TIMER_DISPLAY_INIT, data[len] * 1000);
+            return;
+        }
+    }
     
     // Backlight on
     pin_write(chip->LED, 1);
     
     printf("Display ready\n");
+    chip->display_ready = 1;
+    request_render(chip);
+}
+
+static void start_display_init(chip_state_t *chip) {
+    printf("Initializing %s (%ux%u)...\n", chip->panel->name,
+           (unsigned)chip->panel->width, (unsigned)chip->panel->height);
+    chip->display_ready = 0;
+    chip->display_init_pos = 0;
+    display_init_callback(chip);
 }
 
 static void init_callback(void *user_data) {
     chip_state_t *chip = (chip_state_t*)user_data;
     
-    init_display(chip);
-    
     // Check SD card
     chip->sd_card_present = (pin_read(chip->SD_CD) == 0);
     if (chip->sd_card_present) {
@@ -1087,26 +2243,28 @@ static void init_callback(void *user_data) {
     
     // Load program for preview
     load_program_c(chip);
-    update_display(chip);
+    request_render(chip);
     
-    // Start timers
-    const timer_config_t main_config = {
-        .callback = main_timer_callback,
-        .user_data = chip,
-    };
-    chip->timer = timer_init(&main_config);
-    timer_start(chip->timer, 100000, 0);
-    
-    const timer_config_t display_config = {
-        .callback = display_timer_callback,
+    // Inputs are edge triggered from here on
+    const pin_watch_config_t input_watch = {
+        .edge = BOTH,
+        .pin_change = input_change_callback,
         .user_data = chip,
     };
-    chip->display_timer = timer_init(&display_config);
-    timer_start(chip->display_timer, 1000000, 0);
+    pin_watch(chip->SD_CD, &input_watch);
+    pin_watch(chip->RUN_BTN, &input_watch);
     
     printf("System ready. Press RUN_BTN to execute program.c\n");
 }
 
+static const timer_def_t timer_defs[TIMER_COUNT] = {
+    [TIMER_INIT]           = { init_callback,           100000,              0 },
+    [TIMER_DISPLAY_INIT]   = { display_init_callback,   0,                   0 },
+    [TIMER_INPUT_DEBOUNCE] = { input_debounce_callback, INPUT_DEBOUNCE_US,   0 },
+    [TIMER_RENDER]         = { render_timer_callback,   RENDER_MIN_FRAME_US, 0 },
+    [TIMER_PROGRAM]        = { program_timer_callback,  EXEC_SLICE_US,       1 },
+};
+
 void chip_init(void) {
     chip_state_t *chip = malloc(sizeof(chip_state_t));
     memset(chip, 0, sizeof(chip_state_t));
@@ -1137,6 +2295,19 @@ void chip_init(void) {
     // Run button
     chip->RUN_BTN = pin_init("COMPILE_BUTTON", INPUT_PULLUP);
     
+#if OUTPUT_UART
+    // Program output stream
+    chip->UART_TX = pin_init("UART_TX", INPUT_PULLUP);
+    const uart_config_t uart_config = {
+        .tx = chip->UART_TX,
+        .rx = NO_PIN,
+        .baud_rate = OUTPUT_UART_BAUD,
+        .write_done = uart_write_done,
+        .user_data = chip,
+    };
+    chip->uart = uart_init(&uart_config);
+#endif
+    
     // Set initial pin states
     pin_write(chip->VCC, 1);
     pin_write(chip->GND, 0);
@@ -1152,19 +2323,21 @@ void chip_init(void) {
     pin_write(chip->SD_MOSI, 1);
     pin_write(chip->SD_SCK, 0);
     
+    // Display panel
+    uint32_t panel = attr_init("panel", 0);
+    if (panel >= PANEL_COUNT) {
+        printf("Unknown panel %lu, using %s\n", (unsigned long)panel, panels[0].name);
+        panel = 0;
+    }
+    chip->panel = &panels[panel];
+    
     // Initialize button state
     chip->btn_pressed = 0;
-    chip->btn_debounce = 0;
     chip->sd_initialized = 0;
     chip->sd_card_present = 0;
     
-    // Setup button callback
-    const pin_watch_config_t btn_watch = {
-        .edge = BOTH,
-        .pin_change = run_btn_callback,
-        .user_data = chip,
-    };
-    pin_watch(chip->RUN_BTN, &btn_watch);
+    // All timers are created here, once
+    timer_pool_init(chip, timer_defs);
     
     // Initialize state
     chip->running = 0;
@@ -1172,15 +2345,11 @@ void chip_init(void) {
     chip->output_value = 0;
     chip->program_loaded = 0;
     chip->var_count = 0;
-    chip->output_count = 0;
+    chip->output_total = 0;
     
-    // Start initialization
-    const timer_config_t init_config = {
-        .callback = init_callback,
-        .user_data = chip,
-    };
-    timer_t init_timer = timer_init(&init_config);
-    timer_start(init_timer, 100000, 0);
+    // Start initialization, the display comes up on its own timer
+    timer_pool_start(chip, TIMER_INIT);
+    start_display_init(chip);
     
     printf("System initialized. Waiting for RUN_BTN...\n");
 }
\ No newline at end of file
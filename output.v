@@ -11,27 +11,45 @@ module example (
 
     // Input Pins
     input wire MISO,
-    input wire SD_DI,
     input wire SD_DO,
     input wire SD_CD,
     input wire COMPILE_BUTTON,
 
     // Output Registers
-    output reg CS,
-    output reg RST,
-    output reg DC,
-    output reg MOSI,
-    output reg SCK,
-    output reg LED,
-    output reg SD_CS,
-    output reg SD_SCK,
+    output wire LED,
+
+    // Core Outputs
+    output wire CS,
+    output wire RST,
+    output wire DC,
+    output wire MOSI,
+    output wire SCK,
+    output wire SD_CS,
+    output wire SD_DI,
+    output wire SD_SCK,
+    output wire UART_TX,
 
     // Power Pins
     output wire VCC,
     output wire GND
 );
 
+    // System clock, for SPI clocks and delays in generated cores
+    parameter CLK_HZ = 32'd50000000;
+
     // Parameters from C #defines
+    parameter MAX_CODE = 16'd512;
+    parameter VM_STACK_SIZE = 8'd16;
+    parameter MAX_NESTING = 8'd8;
+    parameter ARRAY_ARENA = 16'd256;
+    parameter VM_THREADED = 8'd0;
+    parameter VM_SUPERINSTRUCTIONS = 8'd1;
+    parameter VM_PROFILE = 8'd0;
+    parameter MAX_PROFILED_STATEMENTS = 8'd64;
+    parameter VM_VALUE_BITS = 8'd32;
+    parameter OUTPUT_RING_SIZE = 16'd256;
+    parameter OUTPUT_UART_BAUD = 32'd115200;
+    parameter OUTPUT_UART = 8'd1;
     parameter COLOR_BLACK = 16'h0000;
     parameter COLOR_BLUE = 16'h001F;
     parameter COLOR_RED = 16'hF800;
@@ -45,45 +63,43 @@ module example (
     parameter FONT_WIDTH = 8'd5;
     parameter FONT_HEIGHT = 8'd7;
     parameter FONT_SPACING = 8'd1;
-
-    // Internal Signals
-    reg [31:0] counter;
-    reg [7:0] current_state;
-    reg [7:0] next_state;
+    parameter INIT_LEN_MASK = 8'h3F;
+    parameter INIT_PSEUDO = 8'h40;
+    parameter INIT_DELAY = 8'h80;
+    parameter CC_DIGIT = 8'h01;
+    parameter CC_ALPHA = 8'h02;
+    parameter CC_IDENT = 8'h04;
+    parameter CC_SPACE = 8'h08;
+    parameter CC_OPERATOR = 8'h10;
+    parameter EXEC_SLICE_INSTRUCTIONS = 16'd256;
+    parameter EXEC_SLICE_US = 16'd1000;
+    parameter LOOP_LIMIT = 16'd10000;
+    parameter RENDER_MIN_FRAME_US = 32'd250000;
+    parameter INPUT_DEBOUNCE_US = 16'd50000;
 
     // Button debouncing signals
     reg COMPILE_BUTTON_debounced;
     reg [15:0] COMPILE_BUTTON_debounce_counter;
 
-    // Generic signals
-    reg [31:0] timer_counter;
-    reg busy_flag;
-
     // Power pin assignments
     assign VCC = 1'b1;
     assign GND = 1'b0;
 
     // ============================================
-    // Clock and Reset Logic
+    // Microsecond Prescaler
     // ============================================
+    // Exact for whole-MHz CLK_HZ
+    localparam US_CYCLES = CLK_HZ / 1000000;
+    reg [$clog2(US_CYCLES + 1)-1:0] us_count;
+    wire us_tick = (us_count == US_CYCLES - 1);
+    
     always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            // Reset all registers
-            counter <= 32'd0;
-            current_state <= 8'd0;
-            timer_counter <= 32'd0;
-            busy_flag <= 1'b0;
-            COMPILE_BUTTON_debounced <= 1'b0;
-            COMPILE_BUTTON_debounce_counter <= 16'd0;
+            us_count <= 0;
+        end else if (us_tick) begin
+            us_count <= 0;
         end else begin
-            // Normal operation
-            counter <= counter + 1;
-            current_state <= next_state;
-            
-            // Decrement timer
-            if (timer_counter > 0) begin
-                timer_counter <= timer_counter - 1;
-            end
+            us_count <= us_count + 1;
         end
     end
 
@@ -91,15 +107,15 @@ module example (
     // Button Debouncing
     // ============================================
 
-    // Debounce COMPILE_BUTTON
+    // Debounce COMPILE_BUTTON: follows once stable for 50000 us (TIMER_INPUT_DEBOUNCE)
     always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            COMPILE_BUTTON_debounced <= 1'b0;
+            COMPILE_BUTTON_debounced <= 1'b1;
             COMPILE_BUTTON_debounce_counter <= 16'd0;
         end else begin
             if (COMPILE_BUTTON != COMPILE_BUTTON_debounced) begin
-                if (COMPILE_BUTTON_debounce_counter < 16'd5000) begin
-                    COMPILE_BUTTON_debounce_counter <= COMPILE_BUTTON_debounce_counter + 1;
+                if (COMPILE_BUTTON_debounce_counter < 16'd50000) begin
+                    if (us_tick) COMPILE_BUTTON_debounce_counter <= COMPILE_BUTTON_debounce_counter + 16'd1;
                 end else begin
                     COMPILE_BUTTON_debounced <= COMPILE_BUTTON;
                     COMPILE_BUTTON_debounce_counter <= 16'd0;
@@ -111,62 +127,1163 @@ module example (
     end
 
     // ============================================
-    // Main State Machine
+    // Timer Tick Generators (from C timer periods)
     // ============================================
-    localparam [7:0]
-        STATE_IDLE     = 8'd0,
-        STATE_INIT     = 8'd1,
-        STATE_RUN      = 8'd2,
-        STATE_WAIT     = 8'd3;
+
+    // init: one-shot 100000 us, armed out of reset (TIMER_INIT)
+    reg init_armed;
+    reg [16:0] init_us;
+    wire init_tick = init_armed && us_tick && (init_us == 17'd99999);
     
-    always @(*) begin
-        next_state = current_state;
-        busy_flag = 1'b0;
-        
-        case (current_state)
-            STATE_IDLE: begin
-                if (counter[20] == 1'b1) begin
-                    next_state = STATE_INIT;
-                end
-            end
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            init_armed <= 1'b1;
+            init_us <= 17'd0;
+        end else if (init_tick) begin
+            init_armed <= 1'b0;
+        end else if (init_armed && us_tick) begin
+            init_us <= init_us + 1;
+        end
+    end
+
+    // program: every 1000 us, free-running (TIMER_PROGRAM)
+    reg [9:0] program_us;
+    wire program_tick = us_tick && (program_us == 10'd999);
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            program_us <= 10'd0;
+        end else if (us_tick) begin
+            program_us <= (program_us == 10'd999) ? 10'd0 : program_us + 1;
+        end
+    end
+
+    // ============================================
+    // SPI Masters (from bit-banged SPI helpers)
+    // ============================================
+
+    // spi: SCK=SCK MOSI=MOSI CS=CS DC=DC; mode 0, MSB first, one byte per 8 SCK cycles
+    parameter SPI_CLK_DIV = 4;     // SCK = clk / (2 * SPI_CLK_DIV)
+    // Transmit side driven by the display sequencer
+    wire [7:0] spi_tx_data;
+    wire spi_tx_dc;
+    wire spi_tx_valid;
+    wire spi_tx_ready;
+    wire [7:0] spi_rx_data;
+    wire spi_rx_valid;
+    wire spi_busy;
+    
+    example_spi_master #(
+        .CLK_DIV(SPI_CLK_DIV),
+        .SLOW_DIV(SPI_CLK_DIV),
+        .FIFO_BITS(4),
+        .LSB_FIRST(0)
+    ) spi_master (
+        .clk(clk),
+        .rst_n(rst_n),
+        .tx_data(spi_tx_data),
+        .tx_dc(spi_tx_dc),
+        .tx_valid(spi_tx_valid),
+        .tx_ready(spi_tx_ready),
+        .rx_data(spi_rx_data),
+        .rx_valid(spi_rx_valid),
+        .busy(spi_busy),
+        .slow(1'b0),
+        .hold_cs(1'b0),
+        .no_cs(1'b0),
+        .sck(SCK),
+        .mosi(MOSI),
+        .cs_n(CS),
+        .dc(DC),
+        .miso(1'b1)
+    );
+
+    // sd_spi: SCK=SD_SCK MOSI=SD_DI MISO=SD_DO CS=SD_CS; mode 0, MSB first, one byte per 8 SCK cycles
+    parameter SD_SPI_CLK_DIV = 4;     // SCK = clk / (2 * SD_SPI_CLK_DIV)
+    parameter SD_SPI_SLOW_DIV = CLK_HZ / 800000;     // 400 kHz SCK during card init
+    // Transmit side and CS control driven by the SD controller
+    wire [7:0] sd_spi_tx_data;
+    wire sd_spi_tx_dc = 1'b0;
+    wire sd_spi_tx_valid;
+    wire sd_spi_slow;
+    wire sd_spi_hold_cs;
+    wire sd_spi_no_cs;
+    wire sd_spi_tx_ready;
+    wire [7:0] sd_spi_rx_data;
+    wire sd_spi_rx_valid;
+    wire sd_spi_busy;
+    
+    example_spi_master #(
+        .CLK_DIV(SD_SPI_CLK_DIV),
+        .SLOW_DIV(SD_SPI_SLOW_DIV),
+        .FIFO_BITS(4),
+        .LSB_FIRST(0)
+    ) sd_spi_master (
+        .clk(clk),
+        .rst_n(rst_n),
+        .tx_data(sd_spi_tx_data),
+        .tx_dc(sd_spi_tx_dc),
+        .tx_valid(sd_spi_tx_valid),
+        .tx_ready(sd_spi_tx_ready),
+        .rx_data(sd_spi_rx_data),
+        .rx_valid(sd_spi_rx_valid),
+        .busy(sd_spi_busy),
+        .slow(sd_spi_slow),
+        .hold_cs(sd_spi_hold_cs),
+        .no_cs(sd_spi_no_cs),
+        .sck(SD_SCK),
+        .mosi(SD_DI),
+        .cs_n(SD_CS),
+        .dc(),
+        .miso(SD_DO)
+    );
+
+    // ============================================
+    // Constant Tables (ROM)
+    // ============================================
+
+    // ili9341_init: static const uint8_t ili9341_init[18], address = index
+    wire [4:0] ili9341_init_addr;    // Driven by the display sequencer
+    wire [7:0] ili9341_init_data;
+    
+    example_rom #(
+        .WIDTH(8),
+        .DEPTH(18),
+        .ADDR_BITS(5),
+        .INIT_FILE("example_ili9341_init.hex")
+    ) ili9341_init_rom (
+        .clk(clk),
+        .addr(ili9341_init_addr),
+        .data(ili9341_init_data)
+    );
+
+    // ============================================
+    // Display Sequencer (init table + fill engine)
+    // ============================================
+    // Runs ili9341_init on spi after reset; once display_ready, a
+    // display_fill_start pulse fills the inclusive window with one color
+    reg display_fill_start = 1'b0;
+    reg [15:0] display_fill_x0 = 16'd0;
+    reg [15:0] display_fill_y0 = 16'd0;
+    reg [15:0] display_fill_x1 = 16'd239;
+    reg [15:0] display_fill_y1 = 16'd319;
+    reg [15:0] display_fill_color = 16'd0;
+    wire display_ready;
+    wire display_fill_busy;
+    
+    example_display #(
+        .CLK_HZ(CLK_HZ),
+        .INIT_LEN(18),
+        .ROM_BITS(5),
+        .WIDTH(240),
+        .HEIGHT(320),
+        .MADCTL(8'h48),
+        .PIXEL_FORMAT(8'h55),
+        .LEN_MASK(8'h3F),
+        .PSEUDO(8'h40),
+        .DELAY(8'h80),
+        .OP_RST_LOW(8'd0),
+        .OP_RST_HIGH(8'd1),
+        .OP_PIXEL_FORMAT(8'd2),
+        .OP_MADCTL(8'd3)
+    ) display (
+        .clk(clk),
+        .rst_n(rst_n),
+        .rom_addr(ili9341_init_addr),
+        .rom_data(ili9341_init_data),
+        .tx_data(spi_tx_data),
+        .tx_dc(spi_tx_dc),
+        .tx_valid(spi_tx_valid),
+        .tx_ready(spi_tx_ready),
+        .spi_busy(spi_busy),
+        .panel_rst(RST),
+        .ready(display_ready),
+        .fill_start(display_fill_start),
+        .fill_x0(display_fill_x0),
+        .fill_y0(display_fill_y0),
+        .fill_x1(display_fill_x1),
+        .fill_y1(display_fill_y1),
+        .fill_color(display_fill_color),
+        .fill_busy(display_fill_busy)
+    );
+
+    // ============================================
+    // SD Card Controller (SPI mode, sector reads)
+    // ============================================
+    // Initializes the card whenever one is present; once sd_ready, a
+    // sd_read_start pulse loads sd_read_sector into the sector buffer,
+    // read back through sd_buf_addr / sd_buf_data (one cycle latency)
+    reg sd_read_start = 1'b0;
+    reg [31:0] sd_read_sector = 32'd0;
+    reg [8:0] sd_buf_addr = 9'd0;
+    wire [7:0] sd_buf_data;
+    wire sd_ready;
+    wire sd_read_done;
+    wire sd_read_error;
+    wire sd_init_error;
+    
+    example_sd #(
+        .CLK_HZ(CLK_HZ)
+    ) sd (
+        .clk(clk),
+        .rst_n(rst_n),
+        .card_present(!SD_CD),
+        .tx_data(sd_spi_tx_data),
+        .tx_valid(sd_spi_tx_valid),
+        .tx_ready(sd_spi_tx_ready),
+        .rx_data(sd_spi_rx_data),
+        .rx_valid(sd_spi_rx_valid),
+        .slow(sd_spi_slow),
+        .hold_cs(sd_spi_hold_cs),
+        .no_cs(sd_spi_no_cs),
+        .ready(sd_ready),
+        .init_error(sd_init_error),
+        .read_start(sd_read_start),
+        .read_sector(sd_read_sector),
+        .read_done(sd_read_done),
+        .read_error(sd_read_error),
+        .buf_addr(sd_buf_addr),
+        .buf_data(sd_buf_data)
+    );
+
+    // ============================================
+    // UART Transmitters (from uart_init configs)
+    // ============================================
+
+    // uart: TX=UART_TX, 8N1 at OUTPUT_UART_BAUD; the line idles high
+    parameter UART_BAUD = 115200;
+    reg [7:0] uart_tx_data = 8'd0;
+    reg uart_tx_valid = 1'b0;
+    wire uart_tx_ready;
+    
+    example_uart_tx #(
+        .CLK_HZ(CLK_HZ),
+        .BAUD(UART_BAUD)
+    ) uart_tx (
+        .clk(clk),
+        .rst_n(rst_n),
+        .tx_data(uart_tx_data),
+        .tx_valid(uart_tx_valid),
+        .tx_ready(uart_tx_ready),
+        .tx(UART_TX)
+    );
+
+    // Outputs with no generated logic, held at their idle level
+    assign LED = 1'b1;
+
+endmodule
+
+// ============================================================
+// SPI master, mode 0, with a byte FIFO and valid/ready interface.
+// Bytes queued back to back keep CS low; each byte takes 16 * CLK_DIV
+// clocks (SLOW_DIV while slow is set) and the byte clocked in meanwhile
+// comes out on rx_data. hold_cs keeps CS low between transfers, no_cs
+// shifts with CS high (SD card power-up clocks).
+// ============================================================
+module example_spi_master #(
+    parameter CLK_DIV = 4,          // clk cycles per SCK half period
+    parameter SLOW_DIV = 4,         // Same, while slow is set
+    parameter FIFO_BITS = 4,        // FIFO depth = 2**FIFO_BITS bytes
+    parameter LSB_FIRST = 0
+) (
+    input wire clk,
+    input wire rst_n,
+    
+    // Transmit: {tx_dc, tx_data} accepted when tx_valid && tx_ready
+    input wire [7:0] tx_data,
+    input wire tx_dc,
+    input wire tx_valid,
+    output wire tx_ready,
+    
+    // Receive: one rx_valid pulse per byte shifted out
+    output reg [7:0] rx_data,
+    output reg rx_valid,
+    output wire busy,
+    
+    // Clock and chip select control, sampled as each byte starts
+    input wire slow,
+    input wire hold_cs,
+    input wire no_cs,
+    
+    // SPI pins
+    output reg sck,
+    output reg mosi,
+    output reg cs_n,
+    output reg dc,
+    input wire miso
+);
+    localparam DEPTH = 1 << FIFO_BITS;
+    localparam MAX_DIV = (SLOW_DIV > CLK_DIV) ? SLOW_DIV : CLK_DIV;
+    localparam DIV_BITS = $clog2(MAX_DIV + 1);
+    
+    // FIFO of {dc, data}, storage without reset so it maps to distributed RAM
+    reg [8:0] fifo [0:DEPTH-1];
+    reg [FIFO_BITS:0] wr_ptr;
+    reg [FIFO_BITS:0] rd_ptr;
+    wire fifo_empty = (wr_ptr == rd_ptr);
+    wire fifo_full = (wr_ptr == {~rd_ptr[FIFO_BITS], rd_ptr[FIFO_BITS-1:0]});
+    wire [8:0] fifo_head = fifo[rd_ptr[FIFO_BITS-1:0]];
+    
+    assign tx_ready = !fifo_full;
+    
+    always @(posedge clk) begin
+        if (tx_valid && !fifo_full) begin
+            fifo[wr_ptr[FIFO_BITS-1:0]] <= {tx_dc, tx_data};
+        end
+    end
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            wr_ptr <= 0;
+        end else if (tx_valid && !fifo_full) begin
+            wr_ptr <= wr_ptr + 1;
+        end
+    end
+    
+    // Shifter: MOSI changes on the falling edge, MISO is sampled on the rising edge
+    reg active;
+    reg [7:0] shift;
+    reg [2:0] bit_count;
+    reg [DIV_BITS-1:0] div;
+    reg slow_byte;
+    wire half_period = (div == (slow_byte ? SLOW_DIV - 1 : CLK_DIV - 1));
+    wire [7:0] next_byte = fifo_head[7:0];
+    
+    assign busy = active || !fifo_empty;
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            rd_ptr <= 0;
+            active <= 1'b0;
+            shift <= 8'd0;
+            bit_count <= 3'd0;
+            div <= 0;
+            slow_byte <= 1'b0;
+            rx_data <= 8'd0;
+            rx_valid <= 1'b0;
+            sck <= 1'b0;
+            mosi <= 1'b0;
+            cs_n <= 1'b1;
+            dc <= 1'b0;
+        end else begin
+            rx_valid <= 1'b0;
             
-            STATE_INIT: begin
-                busy_flag = 1'b1;
-                if (timer_counter == 0) begin
-                    next_state = STATE_RUN;
+            if (!active) begin
+                if (!fifo_empty) begin
+                    // Load: first bit and D/C settle half a period before SCK rises
+                    active <= 1'b1;
+                    shift <= next_byte;
+                    mosi <= LSB_FIRST ? next_byte[0] : next_byte[7];
+                    dc <= fifo_head[8];
+                    cs_n <= no_cs;
+                    slow_byte <= slow;
+                    bit_count <= 3'd0;
+                    div <= 0;
+                    rd_ptr <= rd_ptr + 1;
+                end else begin
+                    cs_n <= !hold_cs;
                 end
-            end
-            
-            STATE_RUN: begin
-                busy_flag = 1'b1;
-                if (counter[23] == 1'b1) begin
-                    next_state = STATE_WAIT;
+            end else if (!half_period) begin
+                div <= div + 1;
+            end else begin
+                div <= 0;
+                if (!sck) begin
+                    sck <= 1'b1;
+                    shift <= LSB_FIRST ? {miso, shift[7:1]} : {shift[6:0], miso};
+                end else begin
+                    sck <= 1'b0;
+                    bit_count <= bit_count + 1;
+                    if (bit_count != 3'd7) begin
+                        mosi <= LSB_FIRST ? shift[0] : shift[7];
+                    end else begin
+                        rx_data <= shift;
+                        rx_valid <= 1'b1;
+                        if (!fifo_empty) begin
+                            // Next byte straight away, CS stays low
+                            shift <= next_byte;
+                            mosi <= LSB_FIRST ? next_byte[0] : next_byte[7];
+                            dc <= fifo_head[8];
+                            cs_n <= no_cs;
+                            slow_byte <= slow;
+                            rd_ptr <= rd_ptr + 1;
+                        end else begin
+                            active <= 1'b0;
+                            cs_n <= !hold_cs;
+                        end
+                    end
                 end
             end
-            
-            STATE_WAIT: begin
-                if (timer_counter == 0) begin
-                    next_state = STATE_RUN;
+        end
+    end
+endmodule
+
+// ============================================================
+// Display command sequencer. The init ROM is microcode steps of
+// cmd, flags, (flags & LEN_MASK) parameters, [delay ms], with PSEUDO
+// marking OP_* operations (any other pseudo cmd only delays). Fills
+// send CASET/PASET/RAMWR and then two bytes per pixel, one FIFO push
+// every other clock, so the SPI master never starves and a clear runs
+// at SPI line rate.
+// ============================================================
+module example_display #(
+    parameter CLK_HZ = 50000000,
+    parameter INIT_LEN = 16,        // Bytes in the init ROM
+    parameter ROM_BITS = 4,
+    parameter WIDTH = 240,
+    parameter HEIGHT = 320,
+    parameter [7:0] MADCTL = 8'h48,
+    parameter [7:0] PIXEL_FORMAT = 8'h55,
+    parameter [7:0] LEN_MASK = 8'h3F,
+    parameter [7:0] PSEUDO = 8'h40,
+    parameter [7:0] DELAY = 8'h80,
+    parameter [7:0] OP_RST_LOW = 8'd0,
+    parameter [7:0] OP_RST_HIGH = 8'd1,
+    parameter [7:0] OP_PIXEL_FORMAT = 8'd2,
+    parameter [7:0] OP_MADCTL = 8'd3
+) (
+    input wire clk,
+    input wire rst_n,
+    
+    // Init ROM, synchronous with one cycle latency
+    output wire [ROM_BITS-1:0] rom_addr,
+    input wire [7:0] rom_data,
+    
+    // SPI master transmit side
+    output wire [7:0] tx_data,
+    output wire tx_dc,
+    output wire tx_valid,
+    input wire tx_ready,
+    input wire spi_busy,
+    
+    output reg panel_rst,
+    output wire ready,
+    
+    // Fill engine: window inside WIDTH x HEIGHT, accepted when ready
+    input wire fill_start,
+    input wire [15:0] fill_x0,
+    input wire [15:0] fill_y0,
+    input wire [15:0] fill_x1,
+    input wire [15:0] fill_y1,
+    input wire [15:0] fill_color,
+    output reg fill_busy
+);
+    localparam MS_TICKS = CLK_HZ / 1000;
+    localparam MS_BITS = $clog2(MS_TICKS + 1);
+    localparam PIXEL_BITS = $clog2(WIDTH * HEIGHT + 1);
+    
+    localparam [3:0]
+        S_CMD    = 4'd0,    // Fetch step command
+        S_FLAGS  = 4'd1,    // Fetch flags, send command or decode pseudo op
+        S_PARAM  = 4'd2,    // Fetch and send parameters
+        S_PSEUDO = 4'd3,
+        S_INLINE = 4'd4,    // Parameter of a pseudo op command
+        S_NEXT   = 4'd5,    // Fetch delay, if any
+        S_DELAY  = 4'd6,
+        S_READY  = 4'd7,
+        S_WINDOW = 4'd8,    // CASET, PASET, RAMWR
+        S_PIXELS = 4'd9,
+        S_PUSH   = 4'd10;   // Hold out_byte until the FIFO takes it
+    
+    reg [3:0] state;
+    reg [3:0] ret;
+    reg [ROM_BITS:0] pc;
+    reg fetched;                // rom_data holds the byte at pc
+    reg [7:0] cmd;
+    reg [7:0] flags;
+    reg [5:0] count;
+    reg [7:0] param;
+    reg [7:0] ms_left;
+    reg [MS_BITS-1:0] ms_tick;
+    reg [7:0] out_byte;
+    reg out_dc;
+    reg [3:0] window_step;
+    reg [15:0] x0, y0, x1, y1;
+    reg [15:0] color;
+    reg [PIXEL_BITS-1:0] pixels_left;
+    reg low_byte;
+    
+    assign rom_addr = pc[ROM_BITS-1:0];
+    assign tx_data = out_byte;
+    assign tx_dc = out_dc;
+    assign tx_valid = (state == S_PUSH);
+    assign ready = (state == S_READY);
+    
+    // Window bytes as {dc, byte}, CASET/PASET take big-endian start and end
+    reg [8:0] window_byte;
+    always @(*) begin
+        case (window_step)
+            4'd0: window_byte = {1'b0, 8'h2A};
+            4'd1: window_byte = {1'b1, x0[15:8]};
+            4'd2: window_byte = {1'b1, x0[7:0]};
+            4'd3: window_byte = {1'b1, x1[15:8]};
+            4'd4: window_byte = {1'b1, x1[7:0]};
+            4'd5: window_byte = {1'b0, 8'h2B};
+            4'd6: window_byte = {1'b1, y0[15:8]};
+            4'd7: window_byte = {1'b1, y0[7:0]};
+            4'd8: window_byte = {1'b1, y1[15:8]};
+            4'd9: window_byte = {1'b1, y1[7:0]};
+            default: window_byte = {1'b0, 8'h2C};
+        endcase
+    end
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            state <= S_CMD;
+            ret <= S_CMD;
+            pc <= 0;
+            fetched <= 1'b0;
+            cmd <= 8'd0;
+            flags <= 8'd0;
+            count <= 6'd0;
+            param <= 8'd0;
+            ms_left <= 8'd0;
+            ms_tick <= 0;
+            out_byte <= 8'd0;
+            out_dc <= 1'b0;
+            window_step <= 4'd0;
+            x0 <= 16'd0;
+            y0 <= 16'd0;
+            x1 <= 16'd0;
+            y1 <= 16'd0;
+            color <= 16'd0;
+            pixels_left <= 0;
+            low_byte <= 1'b0;
+            panel_rst <= 1'b1;
+            fill_busy <= 1'b0;
+        end else begin
+            case (state)
+                S_CMD: begin
+                    if (pc == INIT_LEN) begin
+                        state <= S_READY;
+                    end else if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        cmd <= rom_data;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        state <= S_FLAGS;
+                    end
                 end
-            end
+                
+                S_FLAGS: begin
+                    if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        flags <= rom_data;
+                        count <= rom_data & LEN_MASK;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        if (rom_data & PSEUDO) begin
+                            state <= S_PSEUDO;
+                        end else begin
+                            out_byte <= cmd;
+                            out_dc <= 1'b0;
+                            ret <= S_PARAM;
+                            state <= S_PUSH;
+                        end
+                    end
+                end
+                
+                S_PARAM: begin
+                    if (count == 0) begin
+                        state <= S_NEXT;
+                    end else if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        out_byte <= rom_data;
+                        out_dc <= 1'b1;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        count <= count - 1;
+                        ret <= S_PARAM;
+                        state <= S_PUSH;
+                    end
+                end
+                
+                S_PSEUDO: begin
+                    if ((cmd == OP_RST_LOW || cmd == OP_RST_HIGH) && spi_busy) begin
+                        // Reset edges wait for bytes still in the FIFO
+                    end else begin
+                        // Pseudo ops take no ROM parameters, skip any that are there
+                        pc <= pc + count;
+                    end
+                    
+                    if (cmd == OP_RST_LOW || cmd == OP_RST_HIGH) begin
+                        if (!spi_busy) begin
+                            panel_rst <= (cmd == OP_RST_HIGH);
+                            state <= S_NEXT;
+                        end
+                    end else if (cmd == OP_PIXEL_FORMAT || cmd == OP_MADCTL) begin
+                        out_byte <= (cmd == OP_MADCTL) ? 8'h36 : 8'h3A;
+                        out_dc <= 1'b0;
+                        param <= (cmd == OP_MADCTL) ? MADCTL : PIXEL_FORMAT;
+                        ret <= S_INLINE;
+                        state <= S_PUSH;
+                    end else begin
+                        state <= S_NEXT;
+                    end
+                end
+                
+                S_INLINE: begin
+                    out_byte <= param;
+                    out_dc <= 1'b1;
+                    ret <= S_NEXT;
+                    state <= S_PUSH;
+                end
+                
+                S_NEXT: begin
+                    if (!(flags & DELAY)) begin
+                        state <= S_CMD;
+                    end else if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        ms_left <= rom_data;
+                        ms_tick <= 0;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        state <= S_DELAY;
+                    end
+                end
+                
+                S_DELAY: begin
+                    // Counted from when the step's bytes have left the SPI master
+                    if (spi_busy) begin
+                        ms_tick <= 0;
+                    end else if (ms_left == 0) begin
+                        state <= S_CMD;
+                    end else if (ms_tick == MS_TICKS - 1) begin
+                        ms_tick <= 0;
+                        ms_left <= ms_left - 1;
+                    end else begin
+                        ms_tick <= ms_tick + 1;
+                    end
+                end
+                
+                S_READY: begin
+                    if (fill_start) begin
+                        x0 <= fill_x0;
+                        y0 <= fill_y0;
+                        x1 <= fill_x1;
+                        y1 <= fill_y1;
+                        color <= fill_color;
+                        pixels_left <= (fill_x1 - fill_x0 + 1) * (fill_y1 - fill_y0 + 1);
+                        window_step <= 4'd0;
+                        fill_busy <= 1'b1;
+                        state <= S_WINDOW;
+                    end
+                end
+                
+                S_WINDOW: begin
+                    out_dc <= window_byte[8];
+                    out_byte <= window_byte[7:0];
+                    window_step <= window_step + 1;
+                    low_byte <= 1'b0;
+                    ret <= (window_step == 4'd10) ? S_PIXELS : S_WINDOW;
+                    state <= S_PUSH;
+                end
+                
+                S_PIXELS: begin
+                    if (pixels_left == 0) begin
+                        fill_busy <= 1'b0;
+                        state <= S_READY;
+                    end else begin
+                        out_byte <= low_byte ? color[7:0] : color[15:8];
+                        out_dc <= 1'b1;
+                        low_byte <= !low_byte;
+                        if (low_byte) pixels_left <= pixels_left - 1;
+                        ret <= S_PIXELS;
+                        state <= S_PUSH;
+                    end
+                end
+                
+                S_PUSH: begin
+                    if (tx_ready) state <= ret;
+                end
+                
+                default: state <= S_CMD;
+            endcase
+        end
+    end
+endmodule
+
+// ============================================================
+// SD card controller, SPI mode. Power-up clocks and CMD0 / CMD8 /
+// ACMD41 run on the slow SPI clock, CMD58 picks block or byte
+// addressing, then CMD17 reads a sector into a 512-byte dual-port
+// buffer. One byte is in flight at a time: responses decide what is
+// sent next, and the wait for each rx byte costs a few clocks per
+// 16 * CLK_DIV.
+// ============================================================
+module example_sd #(
+    parameter CLK_HZ = 50000000,
+    parameter INIT_TIMEOUT_MS = 1000,   // ACMD41 busy limit
+    parameter TOKEN_TRIES = 10000       // Bytes polled for the data token
+) (
+    input wire clk,
+    input wire rst_n,
+    input wire card_present,
+    
+    // SPI master, mode 0
+    output reg [7:0] tx_data,
+    output wire tx_valid,
+    input wire tx_ready,
+    input wire [7:0] rx_data,
+    input wire rx_valid,
+    output reg slow,
+    output reg hold_cs,
+    output reg no_cs,
+    
+    output wire ready,
+    output reg init_error,
+    
+    // Sector reads, read_done or read_error pulses when finished
+    input wire read_start,
+    input wire [31:0] read_sector,
+    output reg read_done,
+    output reg read_error,
+    
+    // Sector buffer read port
+    input wire [8:0] buf_addr,
+    output reg [7:0] buf_data
+);
+    localparam MS_TICKS = CLK_HZ / 1000;
+    localparam MS_BITS = $clog2(MS_TICKS + 1);
+    
+    // Command states issue a command; the state named after the next
+    // command receives the R1 of the previous one in r1
+    localparam [4:0]
+        S_ABSENT    = 5'd0,     // No card
+        S_POWER     = 5'd1,     // 80 clocks with CS high
+        S_CMD0      = 5'd2,
+        S_CMD8      = 5'd3,
+        S_CMD55     = 5'd4,
+        S_ACMD41    = 5'd5,
+        S_ACMD41_R  = 5'd6,
+        S_OCR       = 5'd7,     // R1 of CMD58, OCR follows
+        S_CCS       = 5'd8,     // First OCR byte, CCS in bit 6
+        S_READY     = 5'd9,
+        S_CMD17     = 5'd10,
+        S_TOKEN     = 5'd11,
+        S_TOKEN_R   = 5'd12,
+        S_DATA      = 5'd13,
+        S_DATA_W    = 5'd14,    // Store rx at count
+        S_CRC       = 5'd15,
+        S_RELEASE   = 5'd16,    // CS high plus 8 clocks, then rel_ret
+        S_DONE      = 5'd17,
+        S_ERROR     = 5'd18,
+        C_SEND      = 5'd19,    // Command subroutine: 6 command bytes
+        C_POLL      = 5'd20,    //   then up to 10 bytes for R1
+        X_PUSH      = 5'd21,    // Byte subroutine: send tx_data
+        X_WAIT      = 5'd22;    //   and wait for the byte shifted in
+    
+    reg [4:0] state;
+    reg [4:0] xfer_ret;
+    reg [4:0] cmd_ret;
+    reg [4:0] rel_ret;
+    reg [7:0] rx;
+    reg [5:0] cmd_index;
+    reg [31:0] cmd_arg;
+    reg [7:0] cmd_crc;
+    reg [9:0] count;
+    reg [13:0] tries;
+    reg [7:0] r1;
+    reg block_addr;             // SDHC/SDXC: CMD17 takes a block number
+    reg [MS_BITS-1:0] ms_tick;
+    reg [15:0] ms_count;
+    reg read_fail;
+    
+    assign tx_valid = (state == X_PUSH);
+    assign ready = (state == S_READY);
+    
+    // Sector buffer: written by the controller, read on the other port
+    reg [7:0] sector_buf [0:511];
+    
+    always @(posedge clk) begin
+        if (state == S_DATA_W) begin
+            sector_buf[count[8:0]] <= rx;
+        end
+    end
+    
+    always @(posedge clk) begin
+        buf_data <= sector_buf[buf_addr];
+    end
+    
+    // Milliseconds since CMD0, for the ACMD41 timeout
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            ms_tick <= 0;
+            ms_count <= 16'd0;
+        end else if (state == S_CMD0) begin
+            ms_tick <= 0;
+            ms_count <= 16'd0;
+        end else if (ms_tick == MS_TICKS - 1) begin
+            ms_tick <= 0;
+            if (ms_count != 16'hFFFF) ms_count <= ms_count + 1;
+        end else begin
+            ms_tick <= ms_tick + 1;
+        end
+    end
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            state <= S_ABSENT;
+            xfer_ret <= S_ABSENT;
+            cmd_ret <= S_ABSENT;
+            rel_ret <= S_ABSENT;
+            tx_data <= 8'hFF;
+            rx <= 8'hFF;
+            cmd_index <= 6'd0;
+            cmd_arg <= 32'd0;
+            cmd_crc <= 8'h00;
+            count <= 10'd0;
+            tries <= 14'd0;
+            r1 <= 8'hFF;
+            block_addr <= 1'b0;
+            read_fail <= 1'b0;
+            slow <= 1'b1;
+            hold_cs <= 1'b0;
+            no_cs <= 1'b0;
+            init_error <= 1'b0;
+            read_done <= 1'b0;
+            read_error <= 1'b0;
+        end else begin
+            read_done <= 1'b0;
+            read_error <= 1'b0;
             
-            default: begin
-                next_state = STATE_IDLE;
+            // A byte in flight always finishes so its rx_valid is not mistaken later
+            if (!card_present && state != X_WAIT) begin
+                state <= S_ABSENT;
+                hold_cs <= 1'b0;
+                slow <= 1'b1;
+                block_addr <= 1'b0;
+                init_error <= 1'b0;
+                count <= 10'd0;
+                tries <= 14'd0;
+            end else begin
+                case (state)
+                    S_ABSENT: begin
+                        state <= S_POWER;
+                    end
+                    
+                    S_POWER: begin
+                        if (count == 10'd10) begin
+                            no_cs <= 1'b0;
+                            count <= 10'd0;
+                            state <= S_CMD0;
+                        end else begin
+                            no_cs <= 1'b1;
+                            tx_data <= 8'hFF;
+                            count <= count + 1;
+                            xfer_ret <= S_POWER;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    S_CMD0: begin
+                        cmd_index <= 6'd0;
+                        cmd_arg <= 32'd0;
+                        cmd_crc <= 8'h95;
+                        cmd_ret <= S_CMD8;
+                        rel_ret <= C_SEND;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_CMD8: begin
+                        if (r1 != 8'h01) begin
+                            // Not idle yet, CMD0 again a few times
+                            tries <= tries + 1;
+                            state <= (tries == 14'd9) ? S_ERROR : S_CMD0;
+                        end else begin
+                            tries <= 14'd0;
+                            cmd_index <= 6'd8;
+                            cmd_arg <= 32'h000001AA;
+                            cmd_crc <= 8'h87;
+                            cmd_ret <= S_CMD55;
+                            rel_ret <= C_SEND;
+                            state <= S_RELEASE;
+                        end
+                    end
+                    
+                    S_CMD55: begin
+                        // CMD8 is an illegal command on v1 cards, which still init
+                        cmd_index <= 6'd55;
+                        cmd_arg <= 32'd0;
+                        cmd_crc <= 8'h01;
+                        cmd_ret <= S_ACMD41;
+                        rel_ret <= C_SEND;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_ACMD41: begin
+                        cmd_index <= 6'd41;
+                        cmd_arg <= 32'h40000000;     // HCS: host supports SDHC
+                        cmd_crc <= 8'h01;
+                        cmd_ret <= S_ACMD41_R;
+                        rel_ret <= C_SEND;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_ACMD41_R: begin
+                        if (r1 == 8'h00) begin
+                            cmd_index <= 6'd58;
+                            cmd_arg <= 32'd0;
+                            cmd_crc <= 8'h01;
+                            cmd_ret <= S_OCR;
+                            rel_ret <= C_SEND;
+                            state <= S_RELEASE;
+                        end else if (ms_count >= INIT_TIMEOUT_MS) begin
+                            state <= S_ERROR;
+                        end else begin
+                            state <= S_CMD55;
+                        end
+                    end
+                    
+                    S_OCR: begin
+                        if (r1 == 8'h00) begin
+                            tx_data <= 8'hFF;
+                            xfer_ret <= S_CCS;
+                            state <= X_PUSH;
+                        end else begin
+                            // No OCR, byte addressing as for SDSC
+                            block_addr <= 1'b0;
+                            slow <= 1'b0;
+                            rel_ret <= S_READY;
+                            state <= S_RELEASE;
+                        end
+                    end
+                    
+                    S_CCS: begin
+                        block_addr <= rx[6];
+                        slow <= 1'b0;
+                        rel_ret <= S_READY;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_READY: begin
+                        if (read_start) begin
+                            cmd_index <= 6'd17;
+                            cmd_arg <= block_addr ? read_sector : {read_sector[22:0], 9'd0};
+                            cmd_crc <= 8'h01;
+                            cmd_ret <= S_CMD17;
+                            count <= 10'd0;
+                            state <= C_SEND;
+                        end
+                    end
+                    
+                    S_CMD17: begin
+                        tries <= 14'd0;
+                        if (r1 != 8'h00) begin
+                            read_fail <= 1'b1;
+                            rel_ret <= S_DONE;
+                            state <= S_RELEASE;
+                        end else begin
+                            state <= S_TOKEN;
+                        end
+                    end
+                    
+                    S_TOKEN: begin
+                        tx_data <= 8'hFF;
+                        xfer_ret <= S_TOKEN_R;
+                        state <= X_PUSH;
+                    end
+                    
+                    S_TOKEN_R: begin
+                        if (rx == 8'hFE) begin
+                            count <= 10'd0;
+                            state <= S_DATA;
+                        end else if (tries == TOKEN_TRIES - 1) begin
+                            read_fail <= 1'b1;
+                            rel_ret <= S_DONE;
+                            state <= S_RELEASE;
+                        end else begin
+                            tries <= tries + 1;
+                            state <= S_TOKEN;
+                        end
+                    end
+                    
+                    S_DATA: begin
+                        if (count == 10'd512) begin
+                            count <= 10'd0;
+                            state <= S_CRC;
+                        end else begin
+                            tx_data <= 8'hFF;
+                            xfer_ret <= S_DATA_W;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    S_DATA_W: begin
+                        count <= count + 1;
+                        state <= S_DATA;
+                    end
+                    
+                    S_CRC: begin
+                        // Read and ignored
+                        if (count == 10'd2) begin
+                            rel_ret <= S_DONE;
+                            state <= S_RELEASE;
+                        end else begin
+                            tx_data <= 8'hFF;
+                            count <= count + 1;
+                            xfer_ret <= S_CRC;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    S_RELEASE: begin
+                        hold_cs <= 1'b0;
+                        no_cs <= 1'b1;
+                        tx_data <= 8'hFF;
+                        count <= 10'd0;
+                        xfer_ret <= rel_ret;
+                        state <= X_PUSH;
+                    end
+                    
+                    S_DONE: begin
+                        read_done <= !read_fail;
+                        read_error <= read_fail;
+                        read_fail <= 1'b0;
+                        state <= S_READY;
+                    end
+                    
+                    S_ERROR: begin
+                        // A read request retries init, as sd_read_sector does;
+                        // the read itself is reported failed
+                        init_error <= 1'b1;
+                        hold_cs <= 1'b0;
+                        if (read_start) begin
+                            read_error <= 1'b1;
+                            init_error <= 1'b0;
+                            slow <= 1'b1;
+                            count <= 10'd0;
+                            tries <= 14'd0;
+                            state <= S_POWER;
+                        end
+                    end
+                    
+                    C_SEND: begin
+                        hold_cs <= 1'b1;
+                        no_cs <= 1'b0;
+                        if (count == 10'd6) begin
+                            count <= 10'd0;
+                            state <= C_POLL;
+                        end else begin
+                            case (count[2:0])
+                                3'd0: tx_data <= {2'b01, cmd_index};
+                                3'd1: tx_data <= cmd_arg[31:24];
+                                3'd2: tx_data <= cmd_arg[23:16];
+                                3'd3: tx_data <= cmd_arg[15:8];
+                                3'd4: tx_data <= cmd_arg[7:0];
+                                default: tx_data <= cmd_crc;
+                            endcase
+                            count <= count + 1;
+                            xfer_ret <= C_SEND;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    C_POLL: begin
+                        if (count != 10'd0 && (rx != 8'hFF || count == 10'd10)) begin
+                            r1 <= rx;
+                            count <= 10'd0;
+                            state <= cmd_ret;
+                        end else begin
+                            tx_data <= 8'hFF;
+                            count <= count + 1;
+                            xfer_ret <= C_POLL;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    X_PUSH: begin
+                        if (tx_ready) state <= X_WAIT;
+                    end
+                    
+                    X_WAIT: begin
+                        if (rx_valid) begin
+                            rx <= rx_data;
+                            state <= xfer_ret;
+                        end
+                    end
+                    
+                    default: state <= S_ABSENT;
+                endcase
             end
-        endcase
+        end
     end
+endmodule
+
+// ============================================================
+// UART transmitter, 8N1, LSB first. A byte is taken on tx_valid while
+// tx_ready; the line is high out of reset and between frames
+// ============================================================
+module example_uart_tx #(
+    parameter CLK_HZ = 50000000,
+    parameter BAUD = 115200
+) (
+    input wire clk,
+    input wire rst_n,
+    input wire [7:0] tx_data,
+    input wire tx_valid,
+    output wire tx_ready,
+    output reg tx
+);
+    localparam BIT_CYCLES = CLK_HZ / BAUD;
+    
+    reg [$clog2(BIT_CYCLES + 1)-1:0] baud_count;
+    reg [3:0] bit_index;            // 0 idle, 1 start, 2..9 data, 10 stop
+    reg [8:0] shift;                // Data bits still to send, then the stop bit
+    
+    assign tx_ready = (bit_index == 4'd0);
     
-    // Timer control logic
     always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            timer_counter <= 32'd0;
+            tx <= 1'b1;
+            baud_count <= 0;
+            bit_index <= 4'd0;
+            shift <= 9'h1FF;
+        end else if (bit_index == 4'd0) begin
+            if (tx_valid) begin
+                tx <= 1'b0;         // Start bit
+                shift <= {1'b1, tx_data};
+                baud_count <= 0;
+                bit_index <= 4'd1;
+            end
+        end else if (baud_count == BIT_CYCLES - 1) begin
+            baud_count <= 0;
+            if (bit_index == 4'd10) begin
+                bit_index <= 4'd0;  // Stop bit sent
+            end else begin
+                tx <= shift[0];
+                shift <= {1'b1, shift[8:1]};
+                bit_index <= bit_index + 1;
+            end
         end else begin
-            case (current_state)
-                STATE_INIT: timer_counter <= 32'd1000000;
-                STATE_WAIT: timer_counter <= 32'd500000;
-                default: if (timer_counter > 0) timer_counter <= timer_counter - 1;
-            endcase
+            baud_count <= baud_count + 1;
         end
     end
+endmodule
 
+// ============================================================
+// Synchronous ROM, one cycle read latency (infers block RAM)
+// ============================================================
+module example_rom #(
+    parameter WIDTH = 8,
+    parameter DEPTH = 256,
+    parameter ADDR_BITS = 8,
+    parameter INIT_FILE = ""
+) (
+    input wire clk,
+    input wire [ADDR_BITS-1:0] addr,
+    output reg [WIDTH-1:0] data
+);
+    reg [WIDTH-1:0] mem [0:DEPTH-1];
+    
+    initial begin
+        $readmemh(INIT_FILE, mem);
+    end
+    
+    always @(posedge clk) begin
+        data <= mem[addr];
+    end
 endmodule
\ No newline at end of file
@@ -7,10 +7,17 @@ All issues eliminated - Production ready
 import sys
 import re
 import os
+import glob
+import json
+import time
+import hashlib
 import argparse
+from concurrent.futures import ProcessPoolExecutor
 from pathlib import Path
-from dataclasses import dataclass
-from typing import List, Dict, Optional
+from dataclasses import dataclass, field
+from typing import List, Dict, Optional, Set, Tuple
+
+__version__ = '1.0.0'
 
 @dataclass
 class PinInfo:
@@ -20,15 +27,381 @@ class PinInfo:
     init_value: Optional[str] = None
     is_power: bool = False
     is_i2c: bool = False
+    mode: Optional[str] = None      # pin_init mode, e.g. INPUT_PULLUP
+    level: Optional[str] = None     # last constant the C code writes, 1'b0 / 1'b1
+
+# C tokens: comments and strings are matched whole so nothing inside them
+# is mistaken for code; whitespace falls between matches
+C_TOKEN = re.compile(r'''
+    (?P<comment>//[^\n]*|/\*.*?\*/)
+  | (?P<string>"(?:\\.|[^"\\\n])*"|'(?:\\.|[^'\\\n])*')
+  | (?P<ident>[A-Za-z_]\w*)
+  | (?P<number>\.?\d[\w.]*)
+  | (?P<op>->|\S)
+''', re.S | re.X)
+
+def strip_comments(content: str) -> str:
+    """Source with comments blanked out, strings left intact"""
+    return C_TOKEN.sub(lambda m: ' ' if m.lastgroup == 'comment' else m.group(), content)
+
+# Wokwi API calls and uart_config_t fields that read or drive a pin
+PIN_WRITERS = {'pin_write'}
+PIN_READERS = {'pin_read', 'pin_watch'}
+PIN_FIELDS = {'tx': 'write', 'rx': 'read'}
+
+@dataclass
+class PinUse:
+    """What one pass over the source learned about pin handles"""
+    names: Dict[str, str]                   # handle (chip field or variable) -> pin_init name
+    modes: Dict[str, str]                   # pin_init name -> mode
+    access: Dict[str, Set[str]]             # handle -> {'read', 'write'}
+    helper_params: Dict[str, Dict[int, Set[str]]]   # function -> pin_t param index -> access
+    calls: List[Tuple[str, str, List[Optional[str]]]]  # (caller, callee, handle per argument)
+    function_access: Dict[str, Dict[str, Set[str]]]     # function -> handle -> direct accesses
+    uart_tx: Set[str]                       # handles given as a uart_config_t .tx
+    levels: Dict[str, str]                  # handle -> last constant written, in source order
+
+# C integer types a static const table may use: bits, signed
+C_INT_TYPES = {
+    'uint8_t': (8, False), 'int8_t': (8, True), 'char': (8, True), 'unsigned char': (8, False),
+    'uint16_t': (16, False), 'int16_t': (16, True), 'short': (16, True), 'unsigned short': (16, False),
+    'uint32_t': (32, False), 'int32_t': (32, True), 'int': (32, True), 'unsigned': (32, False),
+    'unsigned int': (32, False), 'long': (32, True), 'unsigned long': (32, False),
+}
+
+CONST_ARRAY = re.compile(
+    r'static\s+const\s+((?:unsigned\s+|signed\s+)?\w+)\s+(\w+)\s*((?:\[[^\]]*\]\s*)+)=\s*\{')
+
+@dataclass
+class RomInfo:
+    """static const integer array, flattened row-major"""
+    name: str
+    c_type: str
+    width: int
+    signed: bool
+    dims: List[int]
+    values: List[int]
+    origin: Optional[str] = None    # What the contents were built from, when not a C table
+
+@dataclass
+class SpiBus:
+    """Pins of one bit-banged SPI bus, grouped by its clock pin"""
+    name: str
+    sck: str
+    mosi: Optional[str] = None
+    miso: Optional[str] = None
+    cs: Optional[str] = None
+    dc: Optional[str] = None
+    msb_first: bool = True
+
+@dataclass
+class DisplayInfo:
+    """Panel brought up by a command/data init sequence and written through
+    fill_rect-style window + RAMWR streams on an SPI bus with a D/C line"""
+    bus: str
+    init_rom: str
+    rst: Optional[str]
+    width: int
+    height: int
+    madctl: int
+    pixel_format: int
+    step_format: Dict[str, int]     # LEN_MASK, PSEUDO, DELAY bits of a step's flags byte
+    ops: Dict[str, int]             # Pseudo operation -> opcode
+    source: str                     # Init table or init function it came from
+
+@dataclass
+class SdInfo:
+    """SD card in SPI mode on a bit-banged bus (sd_init/sd_read_sector style)"""
+    bus: str
+    cd: Optional[str]               # Card detect input, low when a card is present
+
+@dataclass
+class UartInfo:
+    """TX side of a Wokwi UART (uart_init with a .tx pin), 8N1"""
+    name: str
+    tx: str
+    baud: int
+    source: str                 # .baud_rate expression in the C config
+
+@dataclass
+class TimerInfo:
+    """Wokwi timer with a constant period"""
+    name: str
+    source: str                 # Handle or table designator it came from
+    period_us: int
+    periodic: bool
+    started_at_init: bool       # Armed in chip_init, so out of reset in hardware
+    armed_by_pins: bool = False # (Re)started from a pin_watch change callback: an input debounce
+
+# SD command framing (0x40 | index) and the start-of-data token, as sent and
+# polled for by SPI-mode SD drivers
+SD_COMMAND = re.compile(r'0x40\s*\|\s*\w+')
+SD_DATA_TOKEN = re.compile(r'0x[fF][eE]\b')
+
+# Display init microcode: steps of cmd, flags, (flags & LEN_MASK) parameters,
+# [delay ms if flags & DELAY], where PSEUDO makes cmd one of the operations
+# below. A C init table in this shape is used as it is, with its own masks
+# and opcodes; init code that calls send_cmd/send_data directly is compiled
+# to it with these defaults. OP_NOP matches no operation and only delays.
+INIT_FORMAT = {'LEN_MASK': 0x3F, 'PSEUDO': 0x40, 'DELAY': 0x80}
+INIT_OPS = {'RST_LOW': 0, 'RST_HIGH': 1, 'PIXEL_FORMAT': 2, 'MADCTL': 3}
+OP_NOP = 0xFF
+MIPI_COLMOD = 0x3A
+MIPI_MADCTL = 0x36
+
+# Blocking delays a straight-line init may call, microseconds per unit
+DELAY_CALLS = {'delay': 1000, 'delay_ms': 1000, 'sleep_ms': 1000, 'msleep': 1000, 'HAL_Delay': 1000,
+               'delay_us': 1, 'usleep': 1, 'sleep_us': 1, 'delayMicroseconds': 1}
+
+# Bit-bang helper shape: a counted 8-bit loop that pulses a clock parameter
+# and shifts data out of / into other pin_t parameters
+C_FUNCTION = re.compile(r'^[A-Za-z_][\w \t\*]*?\b(\w+)\s*\(([^)]*)\)\s*\{', re.M)
+SPI_LOOP_MSB = re.compile(r'for\s*\(\s*(?:\w+\s+)?(\w+)\s*=\s*7\s*;\s*\1\s*>=\s*0')
+SPI_LOOP_LSB = re.compile(r'for\s*\(\s*(?:\w+\s+)?(\w+)\s*=\s*0\s*;\s*\1\s*<\s*8\s*;')
+
+class CSourceScanner:
+    """Single pass over C source mapping pin_init() names to the handles
+    they are stored in, and pin accesses (direct or through helpers taking
+    pin_t parameters) back to those handles."""
+    
+    def scan(self, content: str) -> PinUse:
+        use = PinUse(names={}, modes={}, access={}, helper_params={}, calls=[], function_access={},
+                     uart_tx=set(), levels={})
+        params: Dict[str, int] = {}     # pin_t parameters of the current function
+        function = None
+        depth = 0
+        frames = []                     # Open calls: [callee, args, paren level, index of its '(']
+        parens = 0
+        tokens = [(m.lastgroup, m.group()) for m in C_TOKEN.finditer(content)
+                  if m.lastgroup != 'comment']
+        
+        for i, (kind, text) in enumerate(tokens):
+            nxt = tokens[i + 1][1] if i + 1 < len(tokens) else ''
+            top = frames[-1] if frames else None
+            
+            if text == '{':
+                if depth == 0 and function is None and i > 0 and tokens[i - 1][1] == ')':
+                    function, params = self._function_header(tokens, i - 1)
+                depth += 1
+            elif text == '}':
+                depth -= 1
+                if depth == 0:
+                    function, params = None, {}
+            
+            if text == '(':
+                parens += 1
+                if top and top[3] == i:
+                    continue    # The call's own '('
+            elif text == ')' and top and parens == top[2]:
+                parens -= 1
+                self._close_call(use, function, params, frames.pop())
+                continue
+            elif text == ')':
+                parens -= 1
+            elif text == ',' and top and parens == top[2]:
+                top[1].append([])
+                continue
+            
+            # Argument tokens go to the innermost open call
+            if top:
+                top[1][-1].append(text)
+            
+            if kind == 'ident' and nxt == '(':
+                frames.append([text, [[]], parens + 1, i + 1])
+            if text == 'pin_init' and i >= 2 and tokens[i - 1][1] == '=':
+                self._pin_init(use, tokens, i)
+            elif text == '.' and nxt in PIN_FIELDS and i + 3 < len(tokens) and tokens[i + 2][1] == '=':
+                handle = self._handle(self._until(tokens, i + 3))
+                if handle:
+                    use.access.setdefault(handle, set()).add(PIN_FIELDS[nxt])
+                    if nxt == 'tx':
+                        use.uart_tx.add(handle)
+        
+        self._propagate(use)
+        return use
+    
+    def _function_header(self, tokens, close: int):
+        """pin_t parameters of the definition whose ')' is at close"""
+        level = 0
+        j = close
+        while j >= 0:
+            if tokens[j][1] == ')':
+                level += 1
+            elif tokens[j][1] == '(':
+                level -= 1
+                if level == 0:
+                    break
+            j -= 1
+        if j < 1 or tokens[j - 1][0] != 'ident':
+            return None, {}
+        
+        params = {}
+        index = 0
+        prev = ''
+        for kind, text in tokens[j + 1:close]:
+            if text == ',':
+                index += 1
+            elif kind == 'ident' and prev == 'pin_t':
+                params[text] = index
+            prev = text
+        return tokens[j - 1][1], params
+    
+    def _until(self, tokens, start: int) -> List[str]:
+        out = []
+        for j in range(start, len(tokens)):
+            if tokens[j][1] in ',;}':
+                break
+            out.append(tokens[j][1])
+        return out
+    
+    def _handle(self, expr: List[str]) -> Optional[str]:
+        """Pin handle named by an argument: FIELD in x->FIELD / x.FIELD, or a variable"""
+        if len(expr) == 1 and re.match(r'[A-Za-z_]', expr[0]):
+            return expr[0]
+        if len(expr) == 3 and expr[1] in ('->', '.'):
+            return expr[2]
+        return None
+    
+    def _pin_init(self, use: PinUse, tokens, i: int):
+        # <handle> = pin_init("NAME", MODE)
+        if i + 3 >= len(tokens) or tokens[i + 2][0] != 'string':
+            return
+        name = tokens[i + 2][1][1:-1]
+        use.names[tokens[i - 2][1]] = name
+        if tokens[i + 3][1] == ',' and i + 4 < len(tokens):
+            use.modes[name] = tokens[i + 4][1]
+    
+    def _close_call(self, use: PinUse, function, params, frame):
+        callee, args = frame[0], frame[1]
+        handles = [self._handle(arg) for arg in args]
+        if callee in PIN_WRITERS or callee in PIN_READERS:
+            mode = 'write' if callee in PIN_WRITERS else 'read'
+            handle = handles[0] if handles else None
+            if handle in params:
+                use.helper_params.setdefault(function, {}).setdefault(params[handle], set()).add(mode)
+            elif handle:
+                use.access.setdefault(handle, set()).add(mode)
+                use.function_access.setdefault(function, {}).setdefault(handle, set()).add(mode)
+                if mode == 'write' and len(args) > 1 and args[1] in (['0'], ['1'], ['LOW'], ['HIGH']):
+                    use.levels[handle] = "1'b1" if args[1][0] in ('1', 'HIGH') else "1'b0"
+        elif any(handles):
+            # Resolved after the pass, once every helper's parameters are known
+            mapped = [('#%d' % params[h]) if h in params else h for h in handles]
+            use.calls.append((function, callee, mapped))
+    
+    def _propagate(self, use: PinUse):
+        """Push helper parameter accesses out to the handles callers pass in"""
+        changed = True
+        while changed:
+            changed = False
+            for caller, callee, handles in use.calls:
+                for index, modes in use.helper_params.get(callee, {}).items():
+                    if index >= len(handles) or not handles[index]:
+                        continue
+                    handle = handles[index]
+                    if handle.startswith('#'):
+                        target = use.helper_params.setdefault(caller, {}).setdefault(int(handle[1:]), set())
+                    else:
+                        target = use.access.setdefault(handle, set())
+                    if not modes <= target:
+                        target |= modes
+                        changed = True
+
+class CConstExpr:
+    """Recursive-descent evaluator for integer constant expressions with C
+    semantics on 64-bit values: division truncates toward zero, shifts must
+    stay within 0..63, and results wrap to int64. Tokens are ints and
+    operator strings; anything else is a ValueError."""
+    LEVELS = [('|',), ('^',), ('&',), ('<', '>'), ('<<', '>>'), ('+', '-'), ('*', '/', '%')]
+    MAX_DEPTH = 64
+    
+    def __init__(self, tokens: list):
+        self.tokens = tokens
+        self.pos = 0
+    
+    def value(self) -> int:
+        result = self._binary(0, 0)
+        if self.pos != len(self.tokens):
+            raise ValueError(f"unexpected {self.tokens[self.pos]!r}")
+        return result
+    
+    @staticmethod
+    def _wrap(v: int) -> int:
+        v &= (1 << 64) - 1
+        return v - (1 << 64) if v >> 63 else v
+    
+    def _peek(self):
+        return self.tokens[self.pos] if self.pos < len(self.tokens) else None
+    
+    def _binary(self, level: int, depth: int) -> int:
+        if level == len(self.LEVELS):
+            return self._unary(depth)
+        left = self._binary(level + 1, depth)
+        while isinstance(self._peek(), str) and self._peek() in self.LEVELS[level]:
+            op = self.tokens[self.pos]
+            self.pos += 1
+            left = self._apply(op, left, self._binary(level + 1, depth))
+        return left
+    
+    def _apply(self, op: str, a: int, b: int) -> int:
+        if op in ('/', '%'):
+            if b == 0:
+                raise ValueError('division by zero')
+            q = abs(a) // abs(b) * (1 if (a < 0) == (b < 0) else -1)
+            return self._wrap(q if op == '/' else a - q * b)
+        if op in ('<<', '>>'):
+            if not 0 <= b < 64:
+                raise ValueError(f"shift by {b}")
+            return self._wrap(a << b if op == '<<' else a >> b)
+        return self._wrap({
+            '|': a | b, '^': a ^ b, '&': a & b, '<': int(a < b), '>': int(a > b),
+            '+': a + b, '-': a - b, '*': a * b,
+        }[op])
+    
+    def _unary(self, depth: int) -> int:
+        if depth > self.MAX_DEPTH:
+            raise ValueError('expression nested too deep')
+        token = self._peek()
+        self.pos += 1
+        if isinstance(token, int):
+            return self._wrap(token)
+        if token in ('+', '-', '~'):
+            v = self._unary(depth + 1)
+            return self._wrap({'+': v, '-': -v, '~': ~v}[token])
+        if token == '(':
+            v = self._binary(0, depth + 1)
+            if self._peek() != ')':
+                raise ValueError("expected ')'")
+            self.pos += 1
+            return v
+        raise ValueError(f"unexpected {token!r}")
 
 class PerfectedParser:
     def parse(self, content: str) -> dict:
+        lower = content.lower()
+        use = CSourceScanner().scan(content)
+        pins = self._extract_pins(content, use)
+        spi_buses = self._extract_spi(content, use)
+        roms = self._extract_roms(content)
+        display = self._extract_display(content, pins, spi_buses, roms, use)
+        warnings = []
+        if display is None:
+            # A D/C line means a display, driven some way the sequencer cannot replay
+            warnings += [f"display on {bus.name} not recognized (no init table and no straight-line "
+                         f"init function), no display sequencer generated" for bus in spi_buses if bus.dc]
         return {
             'defines': self._extract_defines(content),
-            'pins': self._extract_pins(content),
-            'has_oled': self._detect_oled(content),
-            'has_i2c': self._detect_i2c(content),
-            'has_buttons': self._detect_buttons(content),
+            'pins': pins,
+            'spi_buses': spi_buses,
+            'roms': roms,
+            'display': display,
+            'sd': self._extract_sd(content, pins, spi_buses),
+            'uarts': self._extract_uarts(content, use),
+            'timers': self._extract_timers(content),
+            'has_oled': self._detect_oled(lower),
+            'has_i2c': self._detect_i2c(lower),
+            'has_buttons': self._detect_buttons(lower),
+            'warnings': warnings,
         }
     
     def _extract_defines(self, content: str) -> Dict[str, str]:
@@ -44,21 +417,686 @@ class PerfectedParser:
                         defines[name] = value
         return defines
     
-    def _extract_pins(self, content: str) -> List[PinInfo]:
+    def _extract_roms(self, content: str) -> List[RomInfo]:
+        """static const integer arrays whose elements are constant expressions
+        of numbers, #defines and enum constants; others are skipped"""
+        code = strip_comments(content)
+        symbols = self._extract_enums(code)
+        defines = self._extract_defines(content)
+        roms = []
+        
+        for m in CONST_ARRAY.finditer(code):
+            c_type, name, dims_text = ' '.join(m.group(1).split()), m.group(2), m.group(3)
+            if c_type not in C_INT_TYPES:
+                continue
+            body = self._brace_body(code, m.end() - 1)
+            try:
+                dims = [self._eval_c(d, defines, symbols) if d.strip() else None
+                        for d in re.findall(r'\[([^\]]*)\]', dims_text)]
+                init = self._parse_initializer(body)
+                width, signed = C_INT_TYPES[c_type]
+                if dims[0] is None:
+                    dims[0] = len(init)
+                values = self._flatten(init, dims, defines, symbols)
+            except ValueError:
+                continue
+            mask = (1 << width) - 1
+            roms.append(RomInfo(name, c_type, width, signed, dims, [v & mask for v in values]))
+        
+        return roms
+    
+    def _extract_enums(self, code: str) -> Dict[str, int]:
+        symbols = {}
+        for body in re.findall(r'\benum\s*\w*\s*\{([^}]*)\}', code):
+            value = -1
+            for item in body.split(','):
+                item = item.strip()
+                if not item:
+                    continue
+                if '=' in item:
+                    item, expr = (x.strip() for x in item.split('=', 1))
+                    try:
+                        value = self._eval_c(expr, {}, symbols)
+                    except ValueError:
+                        break
+                else:
+                    value += 1
+                symbols[item] = value
+        return symbols
+    
+    def _brace_body(self, code: str, open_pos: int) -> str:
+        depth = 0
+        for i in range(open_pos, len(code)):
+            if code[i] == '{':
+                depth += 1
+            elif code[i] == '}':
+                depth -= 1
+                if depth == 0:
+                    return code[open_pos:i + 1]
+        raise ValueError('unterminated initializer')
+    
+    def _parse_initializer(self, text: str):
+        """Nested lists of element expression strings"""
+        stack = [[]]
+        item = []
+        for m in C_TOKEN.finditer(text):
+            token = m.group()
+            if token == '{':
+                stack.append([])
+            elif token in (',', '}'):
+                if item:
+                    stack[-1].append(' '.join(item))
+                item = []
+                if token == '}':
+                    done = stack.pop()
+                    stack[-1].append(done)
+            else:
+                item.append(token)
+        return stack[0][0]
+    
+    def _flatten(self, init, dims, defines, symbols) -> List[int]:
+        if len(init) > dims[0]:
+            raise ValueError('too many initializers')
+        if len(dims) == 1:
+            if any(isinstance(x, list) for x in init):
+                raise ValueError('unexpected braces')
+            values = [self._eval_c(x, defines, symbols) for x in init]
+            return values + [0] * (dims[0] - len(values))
+        values = []
+        for row in init:
+            if not isinstance(row, list):
+                raise ValueError('expected braces')
+            values += self._flatten(row, dims[1:], defines, symbols)
+        inner = 1
+        for d in dims[1:]:
+            inner *= d
+        return values + [0] * (inner * (dims[0] - len(init)))
+    
+    def _eval_c(self, expr: str, defines: Dict[str, str], symbols: Dict[str, int], depth: int = 0) -> int:
+        """Integer constant expression: literals, names and arithmetic/bitwise operators"""
+        if depth > 16:
+            raise ValueError('recursive define')
+        out = []
+        end = -1
+        for m in C_TOKEN.finditer(expr):
+            kind, text = m.lastgroup, m.group()
+            adjacent, end = m.start() == end, m.end()
+            if kind == 'number':
+                text = re.sub(r'[uUlL]+$', '', text)
+                if not re.fullmatch(r'0[xX][0-9a-fA-F]+|0[0-7]*|[1-9]\d*', text):
+                    raise ValueError(text)
+                out.append(int(text, 16 if text[:2] in ('0x', '0X') else 8 if text.startswith('0') and len(text) > 1 else 10))
+            elif kind == 'string' and text.startswith("'"):
+                literal = text[1:-1].encode().decode('unicode_escape')
+                if len(literal) != 1:
+                    raise ValueError(text)
+                out.append(ord(literal))
+            elif kind == 'ident' and text in symbols:
+                out.append(symbols[text])
+            elif kind == 'ident' and text in defines:
+                out.append(self._eval_c(defines[text], defines, symbols, depth + 1))
+            elif kind == 'op' and text in '<>' and adjacent and out and out[-1] == text:
+                out[-1] = text * 2      # The tokenizer splits '<<' and '>>'
+            elif kind == 'op' and text in '()+-*/%|&^~<>':
+                out.append(text)
+            else:
+                raise ValueError(text)
+        return CConstExpr(out).value()
+    
+    def _extract_pins(self, content: str, use: PinUse) -> List[PinInfo]:
         pins = []
         seen = set()
         
+        # Access per pin name, through every handle it was stored in
+        written = set()
+        for handle, modes in use.access.items():
+            if 'write' in modes and handle in use.names:
+                written.add(use.names[handle])
+        levels = {use.names[h]: level for h, level in use.levels.items() if h in use.names}
+        
         # Find all pin_init calls
         pattern = r'pin_init\("([^"]+)"'
         for pin_name in re.findall(pattern, content):
             pin_lower = pin_name.lower()
             if pin_lower not in seen:
-                pins.append(self._create_pin_info(pin_name, content))
+                driven = pin_name in written or use.modes.get(pin_name) == 'OUTPUT'
+                pin = self._create_pin_info(pin_name, driven)
+                pin.mode = use.modes.get(pin_name)
+                pin.level = levels.get(pin_name)
+                pins.append(pin)
                 seen.add(pin_lower)
         
         return pins
     
-    def _create_pin_info(self, pin_name: str, content: str) -> PinInfo:
+    def _extract_spi(self, content: str, use: PinUse) -> List[SpiBus]:
+        """SPI buses driven through bit-bang helpers like spi_write(mosi, sck, data),
+        mapped to pins through the handles each call site passes"""
+        code = strip_comments(content)
+        helpers = {}
+        for m in C_FUNCTION.finditer(code):
+            roles = self._spi_roles(m.group(2), self._brace_body(code, m.end() - 1))
+            if roles:
+                helpers[m.group(1)] = roles
+        
+        buses: Dict[str, SpiBus] = {}
+        for caller, callee, handles in use.calls:
+            roles = helpers.get(callee)
+            if not roles:
+                continue
+            pins = {role: use.names.get(handles[index]) if index < len(handles) and handles[index] else None
+                    for role, index in roles.items() if role != 'msb_first'}
+            sck = pins.get('sck')
+            if not sck:
+                continue    # Clock passed through another helper's parameter
+            bus = buses.get(sck)
+            if bus is None:
+                prefix = re.sub(r'_?S?CL?K_?', '', sck, count=1).strip('_').lower()
+                bus = buses[sck] = SpiBus(f"{prefix}_spi" if prefix else "spi", sck,
+                                          msb_first=roles['msb_first'])
+            bus.mosi = bus.mosi or pins.get('mosi')
+            bus.miso = bus.miso or pins.get('miso')
+            
+            # Chip select and data/command lines the caller drives around the transfer
+            for handle, modes in use.function_access.get(caller, {}).items():
+                name = use.names.get(handle)
+                if not name or 'write' not in modes or name in (bus.sck, bus.mosi):
+                    continue
+                parts = name.upper().split('_')
+                if not bus.cs and ('CS' in parts or 'SS' in parts):
+                    bus.cs = name
+                elif not bus.dc and ('DC' in parts or 'RS' in parts):
+                    bus.dc = name
+        
+        return list(buses.values())
+    
+    def _extract_display(self, content: str, pins: List[PinInfo], buses: List[SpiBus],
+                         roms: List[RomInfo], use: PinUse) -> Optional[DisplayInfo]:
+        """Display on an SPI bus with D/C. Its init sequence is either a byte
+        table run by an interpreter loop of the INIT_FORMAT shape (found from
+        the loop itself, geometry and modes from the first row of a struct
+        table that points at the ROM), or the straight-line send_cmd /
+        send_data / delay / reset calls of an init function, compiled to a
+        ROM of that shape and appended to roms."""
+        code = strip_comments(content)
+        defines = self._extract_defines(content)
+        symbols = self._extract_enums(code)
+        bus = next((b for b in buses if b.dc and b.mosi), None)
+        if bus is None:
+            return None
+        rst = next((p.name for p in pins if p.direction == 'output'
+                    and set(p.name.upper().split('_')) & {'RST', 'RESET'}), None)
+        
+        interpreter = self._init_interpreter(code, defines, symbols)
+        if interpreter:
+            init_roms = {r.name: r for r in roms if r.width == 8 and len(r.dims) == 1}
+            panel = self._default_panel(code, init_roms, defines, symbols)
+            if panel:
+                fields = interpreter['fields']
+                return DisplayInfo(bus.name, panel['init'], rst, panel.get('width', 240), panel.get('height', 320),
+                                   panel.get(fields.get('MADCTL'), 0), panel.get(fields.get('PIXEL_FORMAT'), 0x55),
+                                   interpreter['format'], interpreter['ops'], f"table {panel['init']}")
+        
+        calls = self._init_calls(code, use, bus, rst, defines, symbols)
+        if calls is None:
+            return None
+        function, steps = calls
+        try:
+            values = self._encode_init(steps)
+        except ValueError:
+            return None
+        name = 'display_init'
+        while any(r.name == name for r in roms):
+            name += '_seq'
+        roms.append(RomInfo(name, 'uint8_t', 8, False, [len(values)], values,
+                            origin=f"send_cmd/send_data calls in {function}()"))
+        
+        def first_param(cmd, default):
+            return next((s['params'][0] for s in steps if s['cmd'] == cmd and not s['pseudo'] and s['params']),
+                        default)
+        size = {}
+        for key, value in defines.items():
+            m = re.fullmatch(r'(?:\w*_)?(?:SCREEN|DISPLAY|TFT|LCD|PANEL)_?(WIDTH|HEIGHT)|(WIDTH|HEIGHT)', key)
+            if m:
+                try:
+                    size.setdefault((m.group(1) or m.group(2)).lower(), self._eval_c(value, defines, symbols))
+                except ValueError:
+                    pass
+        return DisplayInfo(bus.name, name, rst, size.get('width', 240), size.get('height', 320),
+                           first_param(MIPI_MADCTL, 0), first_param(MIPI_COLMOD, 0x55),
+                           dict(INIT_FORMAT), dict(INIT_OPS), f"{function}()")
+    
+    def _init_interpreter(self, code: str, defines, symbols) -> Optional[dict]:
+        """Step format of a table-driven init loop, recognised by its shape:
+        len = flags & LEN_MASK; a flags test guarding a delay (a timer or
+        delay call) and one guarding the pseudo operations, whose branches
+        compare cmd against the reset, COLMOD and MADCTL opcodes. Returns
+        masks, opcodes and the panel fields COLMOD and MADCTL are sent from."""
+        delays = r'\btimer_\w*start\w*\s*\(|\b(?:%s)\s*\(' % '|'.join(DELAY_CALLS)
+        for m in C_FUNCTION.finditer(code):
+            body = self._brace_body(code, m.end() - 1)
+            length = re.search(r'\b\w+\s*=\s*(\w+)\s*&\s*(\w+)\s*;', body)
+            if not length:
+                continue
+            flags = re.escape(length.group(1))
+            try:
+                fmt = {'LEN_MASK': self._eval_c(length.group(2), defines, symbols), 'PSEUDO': 0, 'DELAY': 0}
+            except ValueError:
+                continue
+            
+            for test in re.finditer(r'if\s*\(\s*!?\s*\(?\s*%s\s*&\s*(\w+)\s*\)?\s*\)\s*\{' % flags, body):
+                try:
+                    mask = self._eval_c(test.group(1), defines, symbols)
+                except ValueError:
+                    continue
+                branch = self._brace_body(body, test.end() - 1)
+                key = 'DELAY' if re.search(delays, branch) else 'PSEUDO'
+                if not fmt[key]:
+                    fmt[key] = mask
+            if not fmt['PSEUDO'] and not fmt['DELAY']:
+                continue
+            
+            ops, fields = {}, {}
+            for test in re.finditer(r'if\s*\(([^{;]*==[^{;]*)\)\s*\{', body):
+                branch = self._brace_body(body, test.end() - 1)
+                try:
+                    codes = [self._eval_c(c, defines, symbols)
+                             for _, c in re.findall(r'\b(\w+)\s*==\s*(\w+)', test.group(1))]
+                except ValueError:
+                    continue
+                write = re.search(r'pin_write\s*\([^,]+,\s*\w+\s*==\s*(\w+)\s*\)', branch)
+                if write and len(codes) == 2:
+                    high = self._eval_c(write.group(1), defines, symbols)
+                    ops['RST_HIGH'] = high
+                    ops['RST_LOW'] = codes[0] if codes[1] == high else codes[1]
+                    continue
+                sent = [int(s, 0) for s in re.findall(r',\s*(0[xX][0-9a-fA-F]+|\d+)\s*\)', branch)]
+                field = re.search(r'(?:->|\.)\s*(\w+)\s*\)', branch)
+                for op, command in (('PIXEL_FORMAT', MIPI_COLMOD), ('MADCTL', MIPI_MADCTL)):
+                    if len(codes) == 1 and command in sent:
+                        ops[op] = codes[0]
+                        if field:
+                            fields[op] = field.group(1)
+            
+            # Operations the loop lacks get opcodes the table cannot contain
+            spare = (c for c in range(254, -1, -1) if c not in ops.values())
+            for op in INIT_OPS:
+                if op not in ops:
+                    ops[op] = next(spare)
+            return {'format': fmt, 'ops': {op: ops[op] for op in INIT_OPS}, 'fields': fields}
+        return None
+    
+    def _init_calls(self, code: str, use: PinUse, bus: SpiBus, rst: Optional[str], defines, symbols):
+        """(function, steps) for the init function whose straight-line calls
+        send the most commands. send_cmd/send_data are whatever functions
+        set the bus's D/C pin to a constant and send a byte parameter;
+        other helpers are followed with their constant arguments, so
+        send_data16(chip, 0x0140) yields two data bytes. Writes to the reset
+        pin and blocking delays (DELAY_CALLS, or timer_start(t, us, false)
+        one-shots) become steps too. A function whose display calls sit in
+        loops or branches is not straight-line and is skipped."""
+        symbols = dict(symbols, LOW=0, HIGH=1, false=0, true=1)
+        functions = {}
+        for m in C_FUNCTION.finditer(code):
+            params = [p.strip() for p in m.group(2).split(',') if p.strip() and p.strip() != 'void']
+            functions[m.group(1)] = ([re.findall(r'\w+', p)[-1] for p in params],
+                                     ['*' in p or '[' in p for p in params],
+                                     self._brace_body(code, m.end() - 1)[1:-1])
+        
+        def handles(pin):
+            return {h for h, n in use.names.items() if n == pin}
+        dc, reset = handles(bus.dc), handles(rst) if rst else set()
+        if not dc:
+            return None
+        pin_write = r'pin_write\s*\(\s*(?:\w+\s*(?:->|\.)\s*)?(%s)\s*,\s*([^)]*)\)'
+        writes_dc = pin_write % '|'.join(map(re.escape, dc))
+        writes_panel = pin_write % '|'.join(map(re.escape, dc | reset))
+        
+        # Senders: D/C held at one constant level, a byte parameter sent
+        senders = {}
+        for name, (params, pointers, body) in functions.items():
+            levels = {v.strip() for _, v in re.findall(writes_dc, body)}
+            values = [p for p, pointer in zip(params, pointers) if not pointer]
+            if len(levels) == 1 and values and levels <= {'0', 'LOW', 'false', '1', 'HIGH', 'true'}:
+                kind = 'data' if levels <= {'1', 'HIGH', 'true'} else 'cmd'
+                senders[name] = (kind, params.index(values[-1]))
+        if 'cmd' not in {kind for kind, _ in senders.values()}:
+            return None
+        
+        # Functions that reach the panel, directly or through helpers
+        reach = set(senders) | {n for n, (_, _, body) in functions.items() if re.search(writes_panel, body)}
+        grew = True
+        while grew:
+            grew = False
+            for name, (_, _, body) in functions.items():
+                if name not in reach and any(re.search(r'\b%s\s*\(' % r, body) for r in reach):
+                    reach.add(name)
+                    grew = True
+        
+        def touches(text):
+            return (any(re.search(r'\b%s\s*\(' % r, text) for r in reach)
+                    or bool(re.search(writes_panel, text)))
+        
+        def delay(steps, us):
+            if not steps:
+                steps.append({'cmd': OP_NOP, 'pseudo': True, 'params': [], 'delay_us': 0})
+            steps[-1]['delay_us'] += us
+        
+        def run(body, env, steps, depth):
+            if depth > 8:
+                raise ValueError('helpers nested too deep')
+            
+            def value(expr):
+                return self._eval_c(expr, dict(defines, **env), {k: v for k, v in symbols.items() if k not in env})
+            
+            for kind, text in self._statements(body):
+                if kind == 'block':
+                    run(text, env, steps, depth)
+                    continue
+                call = re.fullmatch(r'(\w+)\s*\((.*)\)\s*;', text, re.S) if kind == 'simple' else None
+                if call is None:
+                    if touches(text):
+                        raise ValueError('not straight-line')
+                    continue
+                callee, args = call.group(1), self._split_args(call.group(2))
+                if callee in DELAY_CALLS and args:
+                    delay(steps, value(args[0]) * DELAY_CALLS[callee])
+                elif callee == 'timer_start' and len(args) == 3 and value(args[2]) == 0:
+                    delay(steps, value(args[1]))
+                elif callee == 'pin_write' and len(args) == 2:
+                    handle = self._handle_text(args[0])
+                    if handle in reset:
+                        steps.append({'cmd': INIT_OPS['RST_HIGH' if value(args[1]) else 'RST_LOW'],
+                                      'pseudo': True, 'params': [], 'delay_us': 0})
+                    elif handle in dc:
+                        raise ValueError('D/C driven outside the senders')
+                elif callee in senders:
+                    kind, index = senders[callee]
+                    byte = value(args[index]) & 0xFF
+                    if kind == 'cmd':
+                        steps.append({'cmd': byte, 'pseudo': False, 'params': [], 'delay_us': 0})
+                    elif steps and not steps[-1]['pseudo'] and not steps[-1]['delay_us']:
+                        steps[-1]['params'].append(byte)
+                    else:
+                        raise ValueError('data without a command')
+                elif callee in reach and callee in functions:
+                    params, _, callee_body = functions[callee]
+                    bound = {}
+                    for param, arg in zip(params, args):
+                        try:
+                            bound[param] = str(value(arg))
+                        except ValueError:
+                            pass
+                    run(callee_body, bound, steps, depth + 1)
+        
+        best = None
+        for name, (_, _, body) in functions.items():
+            if 'init' not in name.lower() or name not in reach:
+                continue
+            steps = []
+            try:
+                run(body, {}, steps, 0)
+            except ValueError:
+                continue
+            commands = sum(1 for s in steps if not s['pseudo'])
+            if commands and (best is None or commands > best[0]):
+                best = (commands, name, steps)
+        return (best[1], best[2]) if best else None
+    
+    def _encode_init(self, steps: List[dict]) -> List[int]:
+        """Init steps as INIT_FORMAT microcode; delays round up to whole
+        milliseconds and ones over 255 ms continue in OP_NOP steps"""
+        out = []
+        for step in steps:
+            if len(step['params']) > INIT_FORMAT['LEN_MASK']:
+                raise ValueError(f"command 0x{step['cmd']:02X} has too many parameters")
+            ms = -(-step['delay_us'] // 1000)
+            cmd, params, pseudo = step['cmd'], step['params'], step['pseudo']
+            while True:
+                flags = len(params) | (INIT_FORMAT['PSEUDO'] if pseudo else 0) | (INIT_FORMAT['DELAY'] if ms else 0)
+                out += [cmd, flags] + params
+                if ms:
+                    out.append(min(ms, 255))
+                    ms -= min(ms, 255)
+                if not ms:
+                    break
+                cmd, params, pseudo = OP_NOP, [], True
+        return out
+    
+    def _split_args(self, text: str) -> List[str]:
+        """Call arguments split at top-level commas"""
+        args, depth, start = [], 0, 0
+        for m in C_TOKEN.finditer(text):
+            t = m.group()
+            if m.lastgroup != 'op':
+                continue
+            if t in '([{':
+                depth += 1
+            elif t in ')]}':
+                depth -= 1
+            elif t == ',' and depth == 0:
+                args.append(text[start:m.start()].strip())
+                start = m.end()
+        last = text[start:].strip()
+        return args + [last] if last or args else args
+    
+    def _handle_text(self, expr: str) -> Optional[str]:
+        """Pin handle named by an argument's text, like CSourceScanner._handle"""
+        m = re.fullmatch(r'\s*(?:\w+\s*(?:->|\.)\s*)?(\w+)\s*', expr)
+        return m.group(1) if m else None
+    
+    def _statements(self, body: str) -> List[Tuple[str, str]]:
+        """Top-level statements of a function body: ('simple', text up to ;),
+        ('block', inside of { }) or ('control', a whole if/for/while/switch/do)"""
+        tokens = [m for m in C_TOKEN.finditer(body) if m.lastgroup != 'comment']
+        
+        def close(i, opening, closing):
+            depth = 0
+            for j in range(i, len(tokens)):
+                t = tokens[j].group()
+                depth += (t == opening) - (t == closing)
+                if depth == 0:
+                    return j
+            raise ValueError(f"unbalanced {opening}")
+        
+        def statement(i):
+            if i >= len(tokens):
+                raise ValueError('statement expected')
+            t = tokens[i].group()
+            if t == '{':
+                return close(i, '{', '}')
+            if t in ('if', 'for', 'while', 'switch'):
+                j = statement(close(i + 1, '(', ')') + 1)
+                if t == 'if' and j + 1 < len(tokens) and tokens[j + 1].group() == 'else':
+                    j = statement(j + 2)
+                return j
+            if t == 'do':
+                j = statement(i + 1) + 1                # while
+                return close(j + 1, '(', ')') + 1       # ;
+            depth = 0
+            for j in range(i, len(tokens)):
+                if tokens[j].lastgroup == 'op':
+                    t = tokens[j].group()
+                    depth += (t in '([{') - (t in ')]}')
+                    if t == ';' and depth == 0:
+                        return j
+            raise ValueError('missing ;')
+        
+        out, i = [], 0
+        while i < len(tokens):
+            j = statement(i)
+            text = body[tokens[i].start():tokens[j].end()]
+            first = tokens[i].group()
+            if first == '{':
+                out.append(('block', text[1:-1]))
+            elif first in ('if', 'for', 'while', 'switch', 'do'):
+                out.append(('control', text))
+            else:
+                out.append(('simple', text))
+            i = j + 1
+        return out
+    
+    def _extract_sd(self, content: str, pins: List[PinInfo], buses: List[SpiBus]) -> Optional[SdInfo]:
+        """SPI-mode SD driver: command framing and data token in the source,
+        on a bus that reads MISO (preferring one named sd_*)"""
+        code = strip_comments(content)
+        if not SD_COMMAND.search(code) or not SD_DATA_TOKEN.search(code):
+            return None
+        readers = [b for b in buses if b.miso and b.mosi and b.cs]
+        bus = next((b for b in readers if b.name.startswith('sd')), readers[0] if readers else None)
+        if bus is None:
+            return None
+        cd = next((p.name for p in pins if p.direction == 'input'
+                   and set(p.name.upper().split('_')) & {'CD', 'DETECT'}), None)
+        return SdInfo(bus.name, cd)
+    
+    def _extract_uarts(self, content: str, use: PinUse) -> List[UartInfo]:
+        """uart_init() configs with a .tx pin; the baud rate is the config's
+        .baud_rate when it is a constant, else 115200"""
+        code = strip_comments(content)
+        defines = self._extract_defines(content)
+        m = re.search(r'\.baud_rate\s*=\s*([^,}]+)', code)
+        source = m.group(1).strip() if m else '115200'
+        try:
+            baud = self._eval_c(source, defines, self._extract_enums(code))
+        except ValueError:
+            baud = 115200
+        pins = sorted({use.names[h] for h in use.uart_tx if h in use.names})
+        return [UartInfo('uart' if len(pins) == 1 else f"uart{i}", pin, baud, source)
+                for i, pin in enumerate(pins)]
+    
+    def _default_panel(self, code: str, init_roms: Dict[str, RomInfo], defines, symbols) -> Optional[dict]:
+        """Fields of the first row of a static const struct table whose rows name an init ROM"""
+        structs = self._struct_fields(code)
+        for m in re.finditer(r'static\s+const\s+(\w+)\s+\w+\s*\[[^\]]*\]\s*=\s*\{', code):
+            fields = structs.get(m.group(1))
+            if not fields:
+                continue
+            rows = self._parse_initializer(self._brace_body(code, m.end() - 1))
+            if not rows or not isinstance(rows[0], list):
+                continue
+            panel = {}
+            for field, item in zip(fields, rows[0]):
+                if isinstance(item, list):
+                    continue
+                named = [t for t in re.findall(r'\w+', item) if t in init_roms]
+                if named:
+                    panel['init'] = named[0]
+                    break       # A PANEL_INIT(seq)-style macro covers the remaining fields
+                try:
+                    panel[field] = self._eval_c(item, defines, symbols)
+                except ValueError:
+                    pass
+            if 'init' in panel:
+                return panel
+        return None
+    
+    def _struct_fields(self, code: str) -> Dict[str, List[str]]:
+        """Field names, in order, of each typedef struct"""
+        structs = {}
+        for body, type_name in re.findall(r'typedef\s+struct\s*\w*\s*\{([^}]*)\}\s*(\w+)\s*;', code):
+            fields = []
+            for decl in body.split(';'):
+                m = (re.search(r'\(\s*\*\s*(\w+)\s*\)\s*\(', decl)      # Function pointer
+                     or re.search(r'(\w+)\s*(?:\[[^\]]*\])?\s*$', decl))
+                if m:
+                    fields.append(m.group(1))
+            structs[type_name] = fields
+        return structs
+    
+    def _extract_timers(self, content: str) -> List[TimerInfo]:
+        """Timers with a constant period: timer_init() handles started with
+        timer_start(handle, period, periodic), and rows of a static const
+        table of a struct with a period field (a timer pool definition)"""
+        code = strip_comments(content)
+        defines = self._extract_defines(content)
+        symbols = dict(self._extract_enums(code), true=1, false=0)
+        init_body = self._function_body(code, 'chip_init')
+        # Bodies of the callbacks pin_watch() configs point .pin_change at
+        watch_bodies = ''.join(self._function_body(code, cb) for cb in
+                               set(re.findall(r'\.pin_change\s*=\s*(\w+)', code)))
+        timers = []
+        seen = set()
+        
+        def constant(expr):
+            try:
+                return self._eval_c(expr, defines, symbols)
+            except ValueError:
+                return None
+        
+        # handle = timer_init(&config); ... timer_start(handle, period, periodic)
+        # (a NULL config has no callback, e.g. a handle only used for delays)
+        handles = {m.group(1) for m in re.finditer(
+            r'(?:->|\.|\b)(\w+)\s*=\s*timer_init\s*\(\s*(?!(?:NULL|0)\s*\))', code)}
+        for m in re.finditer(r'timer_start\s*\(\s*([^,;]+?)\s*,\s*([^,;]+?)\s*,\s*([^;]+?)\s*\)\s*;', code):
+            handle = re.split(r'->|\.', m.group(1))[-1].strip()
+            period, periodic = constant(m.group(2)), constant(m.group(3))
+            if handle not in handles or period is None or periodic is None or handle in seen:
+                continue
+            seen.add(handle)
+            start = r'timer_start\s*\([^;]*\b%s\b' % re.escape(handle)
+            timers.append(TimerInfo(handle, handle, period, bool(periodic), bool(re.search(start, init_body)),
+                                    bool(re.search(start, watch_bodies))))
+        
+        # static const timer_def_t timer_defs[] = { [ID] = { callback, period, periodic }, ... }
+        structs = self._struct_fields(code)
+        for m in re.finditer(r'static\s+const\s+(\w+)\s+\w+\s*\[[^\]]*\]\s*=\s*\{', code):
+            fields = structs.get(m.group(1), [])
+            period_field = next((f for f in fields if 'period' in f and f != 'periodic'), None)
+            if not period_field:
+                continue
+            body = self._brace_body(code, m.end() - 1)[1:-1]
+            rows = re.findall(r'(?:\[\s*(\w+)\s*\]\s*=\s*)?\{([^{}]*)\}', body)
+            for index, (designator, row) in enumerate(rows):
+                values = dict(zip(fields, (v.strip() for v in row.split(','))))
+                period = constant(values.get(period_field, ''))
+                periodic = constant(values.get('periodic', '0'))
+                if not period or periodic is None:
+                    continue    # Zero period: only ever started with a runtime delay
+                source = designator or f"{m.group(1)}[{index}]"
+                name = re.sub(r'^timer_', '', designator.lower()) if designator else f"timer{index}"
+                if name in seen:
+                    continue
+                seen.add(name)
+                start = r'\w*start\w*\s*\([^;]*\b%s\b' % designator
+                timers.append(TimerInfo(name, source, period, bool(periodic),
+                                        bool(designator) and bool(re.search(start, init_body)),
+                                        bool(designator) and bool(re.search(start, watch_bodies))))
+        
+        return timers
+    
+    def _function_body(self, code: str, name: str) -> str:
+        m = re.search(r'\b%s\s*\([^)]*\)\s*\{' % re.escape(name), code)
+        return self._brace_body(code, m.end() - 1) if m else ''
+    
+    def _spi_roles(self, params_text: str, body: str) -> Optional[dict]:
+        """pin_t parameter index per role ('sck', 'mosi', 'miso') of a bit-bang helper"""
+        if SPI_LOOP_MSB.search(body):
+            msb_first = True
+        elif SPI_LOOP_LSB.search(body):
+            msb_first = False
+        else:
+            return None
+        
+        roles = {}
+        for index, param in enumerate(params_text.split(',')):
+            words = param.split()
+            if len(words) < 2 or words[-2] != 'pin_t':
+                continue
+            p = re.escape(words[-1])
+            if (re.search(r'pin_write\s*\(\s*%s\s*,\s*(?:1|HIGH)\s*\)' % p, body)
+                    and re.search(r'pin_write\s*\(\s*%s\s*,\s*(?:0|LOW)\s*\)' % p, body)):
+                roles['sck'] = index
+            elif re.search(r'pin_write\s*\(\s*%s\s*,[^;]*(?:>>|<<|&)' % p, body):
+                roles['mosi'] = index
+            elif re.search(r'pin_read\s*\(\s*%s\s*\)' % p, body):
+                roles['miso'] = index
+        
+        if 'sck' not in roles or len(roles) < 2:
+            return None
+        roles['msb_first'] = msb_first
+        return roles
+    
+    def _create_pin_info(self, pin_name: str, driven: bool) -> PinInfo:
         pin_lower = pin_name.lower()
         
         # Determine properties
@@ -72,7 +1110,7 @@ class PerfectedParser:
         elif is_i2c:
             direction = 'output'
             pin_type = 'reg'
-        elif re.search(rf'pin_write.*{pin_name}', content, re.IGNORECASE):
+        elif driven:
             direction = 'output'
             pin_type = 'reg'
         else:
@@ -98,45 +1136,379 @@ class PerfectedParser:
             is_i2c=is_i2c
         )
     
-    def _detect_oled(self, content: str) -> bool:
+    # Detection takes the source already lower-cased by parse()
+    def _detect_oled(self, lower: str) -> bool:
         keywords = ['oled', 'framebuffer', 'pixel_x', 'pixel_y', 'sh1107']
-        return any(kw in content.lower() for kw in keywords)
+        return any(kw in lower for kw in keywords)
     
-    def _detect_i2c(self, content: str) -> bool:
+    def _detect_i2c(self, lower: str) -> bool:
         keywords = ['i2c', 'scl', 'sda']
-        return any(kw in content.lower() for kw in keywords)
+        return any(kw in lower for kw in keywords)
     
-    def _detect_buttons(self, content: str) -> bool:
+    def _detect_buttons(self, lower: str) -> bool:
         keywords = ['button', 'up', 'down', 'left', 'right', 'a', 'b']
-        return any(kw in content.lower() for kw in keywords)
+        return any(kw in lower for kw in keywords)
+
+# ============================================================
+# Module IR
+# ============================================================
+# Emitters declare the top module's signals and blocks here, each block
+# with the signals it drives and reads, so the passes can check drivers
+# and drop dead logic before anything is printed
+
+V_IDENT = re.compile(r"(?<![\w.'$`])[A-Za-z_]\w*")
+
+@dataclass
+class IrSignal:
+    """reg/wire declared in the module body"""
+    name: str
+    kind: str                       # reg | wire
+    msb: Optional[str] = None       # [msb:0], None for a single bit
+    signed: bool = False
+    array: str = ''                 # Memory dimension, e.g. "[0:1023]"
+    init: Optional[str] = None      # Initial value; continuous assignment for a wire
+    comment: str = ''
+    max_value: Optional[int] = None # Largest value the logic ever stores, for width minimization
+    
+    def width(self) -> Optional[int]:
+        if self.msb is None:
+            return 1
+        return int(self.msb) + 1 if self.msb.isdigit() else None
+    
+    def render(self) -> str:
+        parts = [self.kind]
+        if self.signed:
+            parts.append('signed')
+        if self.msb is not None:
+            parts.append(f"[{self.msb}:0]")
+        parts.append(self.name + (f" {self.array}" if self.array else ''))
+        init = f" = {self.init}" if self.init is not None else ''
+        comment = f"    // {self.comment}" if self.comment else ''
+        return f"    {' '.join(parts)}{init};{comment}"
+
+@dataclass
+class IrItem:
+    kind: str                       # decl | always | assign | instance | text
+    text: str
+    lead: List[str]                 # Comment and blank lines printed before it
+    signal: Optional[IrSignal] = None
+    drives: Set[str] = field(default_factory=set)
+    reads: Set[str] = field(default_factory=set)
+    
+    def render(self) -> List[str]:
+        body = self.signal.render() if self.signal else self.text
+        return self.lead + (body.split('\n') if body else [])
+
+SIZED = re.compile(r'\x00(\w+):(\d*)\x00')
+
+class ModuleIR:
+    """Ports, signals and blocks of the generated top module"""
+    
+    def __init__(self, name: str):
+        self.name = name
+        self.ports: List[Tuple[str, str, str]] = []     # (group, declaration, name)
+        self.directions: Dict[str, str] = {'clk': 'input', 'rst_n': 'input'}
+        self.sections: List[List[IrItem]] = []
+        self.signals: Dict[str, IrSignal] = {}
+        self.kept: Set[str] = set()
+        self.warnings: List[str] = []
+        self._lead: List[str] = []
+    
+    # ---- Building ----
+    
+    def port(self, group: str, declaration: str, name: str):
+        self.ports.append((group, declaration, name))
+        self.directions[name] = declaration.split()[0]
+    
+    def keep(self, *names: str):
+        """Signals other logic hooks into, live even when nothing reads them yet"""
+        self.kept.update(names)
+    
+    def section(self):
+        """Start a new blank-line separated group of items"""
+        self._flush()
+        self.sections.append([])
+    
+    def comment(self, text: str):
+        """Comment (or blank) lines printed before the next item"""
+        self._lead.extend(text.split('\n'))
+    
+    def text(self, text: str):
+        """Parameters, localparams: no signals driven or read"""
+        self._item(IrItem('text', text, []))
+    
+    def reg(self, name: str, msb=None, init: Optional[str] = None, comment: str = '',
+            max_value: Optional[int] = None, signed: bool = False, array: str = ''):
+        signal = IrSignal(name, 'reg', None if msb is None else str(msb), signed, array, init,
+                          comment, max_value)
+        self.signals[name] = signal
+        self._item(IrItem('decl', '', [], signal))
+    
+    def wire(self, name: str, msb=None, init: Optional[str] = None, reads=(), comment: str = '',
+             signed: bool = False):
+        """A wire, continuously assigned from init (reading reads) if given"""
+        signal = IrSignal(name, 'wire', None if msb is None else str(msb), signed, '', init, comment)
+        self.signals[name] = signal
+        drives = {name} if init is not None else set()
+        self._item(IrItem('decl', '', [], signal, drives, set(reads)))
+    
+    def lit(self, name: str, value: int) -> str:
+        """Constant written at name's final width, settled when rendering
+        (after minimize_widths) so it never mismatches the register"""
+        return f"\x00{name}:{value}\x00"
+    
+    def bits(self, name: str) -> str:
+        """' [msb:0]' of name's final width ('' for a single bit), e.g. for
+        the localparams it is compared with"""
+        return f"\x00{name}:\x00"
+    
+    def always(self, text: str, drives, reads):
+        self._item(IrItem('always', text, [], drives=set(drives), reads=set(reads)))
+    
+    def assign(self, lhs: str, rhs: str, reads=()):
+        self._item(IrItem('assign', f"    assign {lhs} = {rhs};", [], drives={lhs}, reads=set(reads)))
+    
+    def instance(self, module: str, name: str, params: List[Tuple[str, str]],
+                 connections: List[Tuple[str, str, str]]):
+        """Core instance; connections are (port, expression, 'in' | 'out'),
+        an output connected to a signal drives it"""
+        if params:
+            lines = [f"    {module} #("] + [f"        .{p}({v})," for p, v in params]
+            lines[-1] = lines[-1].rstrip(',')
+            lines.append(f"    ) {name} (")
+        else:
+            lines = [f"    {module} {name} ("]
+        lines += [f"        .{port}({expr})," for port, expr, _ in connections]
+        lines[-1] = lines[-1].rstrip(',')
+        lines.append("    );")
+        drives = {expr for _, expr, way in connections if way == 'out' and expr}
+        reads = {ident for _, expr, way in connections if way == 'in' for ident in V_IDENT.findall(expr)}
+        self._item(IrItem('instance', '\n'.join(lines), [], drives=drives, reads=reads))
+    
+    def _item(self, item: IrItem):
+        if not self.sections:
+            self.sections.append([])
+        item.lead, self._lead = self._lead, []
+        self.sections[-1].append(item)
+    
+    def _flush(self):
+        if self._lead:
+            self._item(IrItem('text', '', []))
+    
+    def items(self):
+        return [item for section in self.sections for item in section]
+    
+    def drivers(self) -> Dict[str, List[IrItem]]:
+        found: Dict[str, List[IrItem]] = {}
+        for item in self.items():
+            for name in item.drives:
+                found.setdefault(name, []).append(item)
+        return found
+    
+    def undriven_outputs(self) -> Set[str]:
+        driven = self.drivers()
+        return {name for _, declaration, name in self.ports
+                if declaration.startswith('output') and name not in driven}
+    
+    def retype(self, name: str, declaration: str):
+        """Change a port's declaration, e.g. output reg -> output wire"""
+        self.ports = [(group, declaration if n == name else d, n) for group, d, n in self.ports]
+    
+    def has(self, name: str) -> bool:
+        return name in self.signals or name in self.directions
+    
+    # ---- Passes ----
+    
+    def optimize(self):
+        self._flush()
+        self.check_drivers()
+        self.eliminate_dead()
+        self.minimize_widths()
+    
+    def check_drivers(self):
+        """Blocks only touch declared signals, every signal has at most one
+        driving block; undriven outputs are reported"""
+        for item in self.items():
+            for name in item.drives | item.reads:
+                if not self.has(name):
+                    raise ValueError(f"{self.name}: {name} is used but never declared")
+        for name, items in self.drivers().items():
+            if len(items) > 1:
+                where = ' and '.join(f"'{item.render()[len(item.lead)].strip()}'" for item in items)
+                raise ValueError(f"{self.name}: {name} is driven by {where}")
+        for name in sorted(self.undriven_outputs()):
+            self.warnings.append(f"{name} is never driven")
+    
+    def eliminate_dead(self):
+        """Drop signals that reach no output port or kept hook, along with
+        the blocks that drive them"""
+        live = {name for name, way in self.directions.items() if way == 'output'} | self.kept
+        changed = True
+        while changed:
+            changed = False
+            for item in self.items():
+                # A live block keeps everything it drives (its text assigns them)
+                if item.drives & live and not item.reads | item.drives <= live:
+                    live |= item.reads | item.drives
+                    changed = True
+        
+        sections = []
+        for section in self.sections:
+            kept, banners, heading, removed = [], [], [], False
+            for item in section:
+                if item.kind == 'decl' and item.signal.name not in live \
+                        or item.drives and not item.drives & live:
+                    removed = True
+                    # Section banners survive the item; a group heading moves
+                    # on to the next declaration if that one has none
+                    banner = max((k for k, line in enumerate(item.lead)
+                                  if line.strip().startswith('// ====')), default=-1)
+                    banners += item.lead[:banner + 1]
+                    if item.kind == 'decl' and any(line.strip() for line in item.lead[banner + 1:]):
+                        heading = item.lead[banner + 1:]
+                    continue
+                if banners or heading:
+                    if item.kind != 'decl' or any(line.strip() for line in item.lead):
+                        heading = []
+                    item.lead = banners + heading + item.lead
+                    banners, heading = [], []
+                kept.append(item)
+            # A section left with nothing but comments and parameters goes too
+            if removed and not any(item.kind != 'text' for item in kept):
+                kept = []
+            if kept:
+                sections.append(kept)
+        self.sections = sections
+        self.signals = {name: s for name, s in self.signals.items() if name in live}
+    
+    def minimize_widths(self):
+        """Registers declared wider than the largest value their logic
+        stores shrink to the bits that value needs"""
+        for signal in self.signals.values():
+            if signal.max_value is None or signal.width() is None:
+                continue
+            bits = max(1, signal.max_value.bit_length())
+            if bits < signal.width():
+                signal.msb = str(bits - 1) if bits > 1 else None
+    
+    # ---- Printing ----
+    
+    def render(self) -> str:
+        ports = ["    // Clock and Reset", "    input wire clk,", "    input wire rst_n,"]
+        group = None
+        for title, declaration, name in self.ports:
+            if title != group:
+                ports.extend(["", f"    // {title}"])
+                group = title
+            ports.append(f"    {declaration} {name},")
+        ports[-1] = ports[-1].rstrip(',')
+        parts = [f"module {self.name} (\n" + '\n'.join(ports) + "\n);"]
+        for section in self.sections:
+            lines = [line for item in section for line in item.render()]
+            while lines and not lines[0].strip():
+                lines.pop(0)
+            parts.append('\n'.join(lines))
+        return SIZED.sub(self._sized, '\n\n'.join(parts))
+    
+    def _sized(self, match) -> str:
+        name, value = match.group(1), match.group(2)
+        signal = self.signals.get(name)
+        width = signal.width() if signal else None
+        if not value:
+            return f" [{signal.msb}:0]" if signal and signal.msb is not None else ''
+        if width is None:
+            return value
+        if int(value) >= 1 << width:
+            raise ValueError(f"{self.name}: {value} does not fit {name} ({width} bits)")
+        return f"{width}'d{value}"
+
 
 class PerfectedGenerator:
-    def __init__(self, info: dict, module_name: str):
+    def __init__(self, info: dict, module_name: str, testbench: bool = False):
         self.info = info
         self.module_name = module_name
+        self.testbench = testbench
         self.pins = info['pins']
+        self.spi_buses: List[SpiBus] = info.get('spi_buses', [])
+        self.display: Optional[DisplayInfo] = info.get('display')
+        self.sd: Optional[SdInfo] = info.get('sd')
+        self.uarts: List[UartInfo] = info.get('uarts', [])
+        # A one-shot only started at run time has nothing in hardware to start it
+        self.timers: List[TimerInfo] = [t for t in info.get('timers', []) if t.periodic or t.started_at_init]
+        # The main state machine steps on the boot timer and the first periodic one
+        self.boot_timer = next((t for t in self.timers if t.started_at_init and not t.periodic), None)
+        self.slice_timer = next((t for t in self.timers if t.periodic), None)
+        self.timed = self.boot_timer is not None and self.slice_timer is not None
+        # Button debouncers wait as long as the one-shot the C code re-arms on
+        # every input edge, if it has one
+        self.debounce_timer = next((t for t in info.get('timers', [])
+                                    if t.armed_by_pins and not t.periodic), None)
+        self.debounce_us = self.debounce_timer.period_us if self.debounce_timer else self.DEBOUNCE_US
+        self.side_files: Dict[str, str] = {}    # Extra outputs, e.g. ROM images
         
     def generate(self) -> str:
-        parts = []
-        parts.append(self._header())
-        parts.append(self._module_declaration())
-        parts.append(self._parameters())
-        parts.append(self._internal_signals())
-        parts.append(self._power_assignments())
-        parts.append(self._clock_reset())
+        self.ir = ModuleIR(self.module_name)
+        self._module_declaration()
+        self._parameters()
+        self._internal_signals()
+        self._power_assignments()
+        self._clock_reset()
+        
+        if self.timers or self._button_inputs():
+            self._us_prescaler()
         
         if self.info['has_buttons']:
-            parts.append(self._button_debouncing())
+            self._button_debouncing()
+        
+        if self.timers:
+            self._timer_ticks()
         
-        parts.append(self._state_machine())
+        self._state_machine()
         
         if self.info['has_oled']:
-            parts.append(self._oled_logic())
+            self._oled_logic()
         
         if self.info['has_i2c']:
-            parts.append(self._i2c_logic())
+            self._i2c_logic()
+        
+        if self.spi_buses:
+            self._spi_masters()
+        
+        if self.info['roms']:
+            self._rom_instances()
+        
+        if self.display:
+            self._display_sequencer()
+        
+        if self.sd:
+            self._sd_controller()
+        
+        if self.uarts:
+            self._uart_transmitters()
+        
+        self._idle_outputs()
         
-        parts.append("endmodule")
+        # Single-driver check, dead-signal elimination, width minimization
+        self.ir.optimize()
+        self._rom_images()
+        
+        cores = []
+        if self.spi_buses:
+            cores.append(self._spi_master_module())
+        if self.display:
+            cores.append(self._display_module())
+        if self.sd:
+            cores.append(self._sd_module())
+        if self.uarts:
+            cores.append(self._uart_tx_module())
+        if any(self.ir.has(f"{rom.name}_data") for rom in self.info['roms']):
+            cores.append(self._rom_module())
+        if self.info['has_oled']:
+            cores.append(self._framebuffer_module())
+        
+        parts = [self._header(), self.ir.render(), "endmodule"] + cores
+        if self.testbench:
+            self.side_files[f"{self.module_name}_tb.v"] = self._testbench()
         return '\n\n'.join(parts)
     
     def _header(self) -> str:
@@ -146,68 +1518,58 @@ class PerfectedGenerator:
 // Module: {self.module_name}
 // ============================================================"""
     
-    def _module_declaration(self) -> str:
-        """Generate clean module declaration"""
-        ports = []
-        
-        # Group pins
-        inputs = [p for p in self.pins if p.direction == 'input']
-        reg_outputs = [p for p in self.pins if p.direction == 'output' and p.type == 'reg']
-        wire_outputs = [p for p in self.pins if p.direction == 'output' and p.type == 'wire']
-        
-        # Start with clock and reset
-        ports.append("    // Clock and Reset")
-        ports.append("    input wire clk,")
-        ports.append("    input wire rst_n,")
-        
-        # Add inputs
-        if inputs:
-            ports.append("")
-            ports.append("    // Input Pins")
-            for i, pin in enumerate(inputs):
-                comma = "," if i < len(inputs) - 1 or reg_outputs or wire_outputs else ""
-                ports.append(f"    input wire {pin.name}{comma}")
-        
-        # Add reg outputs
-        if reg_outputs:
-            ports.append("")
-            ports.append("    // Output Registers")
-            for i, pin in enumerate(reg_outputs):
-                comma = "," if i < len(reg_outputs) - 1 or wire_outputs else ""
-                ports.append(f"    output reg {pin.name}{comma}")
-        
-        # Add wire outputs (power pins)
-        if wire_outputs:
-            ports.append("")
-            ports.append("    // Power Pins")
-            for i, pin in enumerate(wire_outputs):
-                comma = "," if i < len(wire_outputs) - 1 else ""
-                ports.append(f"    output wire {pin.name}{comma}")
-        
-        # Clean up
-        port_text = '\n'.join(ports)
-        if port_text.endswith(','):
-            port_text = port_text[:-1]
-        
-        return f"module {self.module_name} (\n{port_text}\n);"
-    
-    def _parameters(self) -> str:
-        if not self.info['defines']:
-            return ""
-        
+    def _module_declaration(self):
+        """Port list, grouped; outputs driven by a generated core are wires"""
+        core = self._core_pins()
+        groups = [
+            ("Input Pins", "input wire", [p for p in self.pins if p.direction == 'input']),
+            ("Output Registers", "output reg", [p for p in self.pins if p.direction == 'output'
+                                                and p.type == 'reg' and p.name not in core]),
+            ("Core Outputs", "output wire", [p for p in self.pins if p.direction == 'output'
+                                                   and p.type == 'reg' and p.name in core]),
+            ("Power Pins", "output wire", [p for p in self.pins if p.direction == 'output' and p.type == 'wire']),
+        ]
+        for title, kind, pins in groups:
+            for pin in pins:
+                self.ir.port(title, kind, pin.name)
+    
+    def _has_clk_hz(self) -> bool:
+        return bool(self.spi_buses or self.timers or self.uarts or self._button_inputs())
+    
+    def _button_inputs(self):
+        """Buttons that get a debouncer"""
+        return self._get_button_inputs()[:8] if self.info['has_buttons'] else []
+    
+    def _core_pins(self) -> Set[str]:
+        """Output pins driven by a generated core (SPI master, display sequencer, UART)"""
+        pins = {pin for bus in self.spi_buses for pin in (bus.sck, bus.mosi, bus.cs, bus.dc) if pin}
+        pins |= {uart.tx for uart in self.uarts}
+        if self.display and self.display.rst:
+            pins.add(self.display.rst)
+        return pins
+    
+    def _parameters(self):
         params = []
-        params.append("    // Parameters from C #defines")
+        if self._has_clk_hz():
+            params.append("    // System clock, for SPI clocks and delays in generated cores")
+            params.append("    parameter CLK_HZ = 32'd50000000;")
+            params.append("")
         
-        for name, value in self.info['defines'].items():
-            verilog_value = self._convert_define(name, value)
-            if verilog_value:
-                params.append(f"    parameter {name} = {verilog_value};")
+        if self.info['defines']:
+            params.append("    // Parameters from C #defines")
         
-        # Add derived parameters
-        if self.info['has_oled']:
-            params.append("    parameter OLED_PAGES = 8;  // 64/8")
+            for name, value in self.info['defines'].items():
+                verilog_value = self._convert_define(name, value)
+                if verilog_value:
+                    params.append(f"    parameter {name} = {verilog_value};")
+            
+            # Add derived parameters
+            if self.info['has_oled']:
+                params.append("    parameter OLED_PAGES = 8;  // 64/8")
         
-        return '\n'.join(params)
+        if params:
+            self.ir.section()
+            self.ir.text('\n'.join(params).rstrip())
     
     def _convert_define(self, name: str, value: str) -> Optional[str]:
         """Convert C define to Verilog parameter with proper width"""
@@ -248,54 +1610,43 @@ class PerfectedGenerator:
         
         return None
     
-    def _internal_signals(self) -> str:
-        signals = []
-        signals.append("    // Internal Signals")
-        signals.append("    reg [31:0] counter;")
-        signals.append("    reg [7:0] current_state;")
-        signals.append("    reg [7:0] next_state;")
+    def _internal_signals(self):
+        ir = self.ir
+        ir.section()
+        ir.comment("    // Internal Signals")
+        ir.reg('counter', 31)
+        ir.reg('current_state', 7, max_value=len(self.STATES) - 1)
+        ir.reg('next_state', 7, max_value=len(self.STATES) - 1)
         
         # Button signals (limit to avoid too much code)
         if self.info['has_buttons']:
-            signals.append("")
-            signals.append("    // Button debouncing signals")
+            ir.comment("\n    // Button debouncing signals")
             button_inputs = self._get_button_inputs()
             for pin in button_inputs[:8]:  # Limit to 8 buttons
-                signals.append(f"    reg {pin.name}_debounced;")
-                signals.append(f"    reg [15:0] {pin.name}_debounce_counter;")
+                ir.reg(f"{pin.name}_debounced")
+                ir.reg(f"{pin.name}_debounce_counter", 15, max_value=self.debounce_us)
         
         # OLED signals
         if self.info['has_oled']:
-            signals.append("")
-            signals.append("    // OLED display signals")
-            signals.append("    reg [15:0] pixel_x;")
-            signals.append("    reg [15:0] pixel_y;")
-            signals.append("    reg [15:0] old_pixel_x;")
-            signals.append("    reg [15:0] old_pixel_y;")
-            signals.append("    reg cursor_inverted;")
-            signals.append("    reg [1:0] current_screen;")
-            signals.append("    reg a_button_was_pressed;")
-            signals.append("    reg [7:0] framebuffer [0:1023];")
+            ir.comment("\n    // OLED display signals")
+            ir.reg('pixel_x', 15)
+            ir.reg('pixel_y', 15)
         
         # I2C signals
         if self.info['has_i2c']:
-            signals.append("")
-            signals.append("    // I2C interface signals")
-            signals.append("    reg [6:0] i2c_address;")
-            signals.append("    reg [7:0] i2c_data_out;")
-            signals.append("    reg i2c_write_active;")
-            signals.append("    reg [2:0] i2c_bit_counter;")
-            signals.append("    reg [2:0] i2c_state;")
-            signals.append("    reg [8:0] i2c_clk_div;")
-            signals.append("    wire i2c_clk_enable;")
+            ir.comment("\n    // I2C interface signals")
+            ir.reg('i2c_address', 6)
+            ir.reg('i2c_data_out', 7)
+            ir.reg('i2c_write_active')
+            ir.reg('i2c_bit_counter', 2, max_value=7)
+            ir.reg('i2c_state', 2, max_value=4)
+            ir.reg('i2c_clk_div', 8, max_value=499)
+            ir.wire('i2c_clk_enable')
         
         # Generic signals
-        signals.append("")
-        signals.append("    // Generic signals")
-        signals.append("    reg [31:0] timer_counter;")
-        signals.append("    reg busy_flag;")
-        
-        return '\n'.join(signals)
+        if not self.timed:
+            ir.comment("\n    // Generic signals")
+            ir.reg('timer_counter', 31, max_value=1000000)
     
     def _get_button_inputs(self):
         """Get button input pins (case-insensitive detection)"""
@@ -307,130 +1658,190 @@ class PerfectedGenerator:
                     button_pins.append(pin)
         return button_pins
     
-    def _power_assignments(self) -> str:
+    def _cursor_buttons(self) -> Dict[str, str]:
+        """Direction ('up', 'down', 'left', 'right') to the button pin moving
+        the OLED cursor that way, from the first four buttons"""
+        if not self.info['has_buttons']:
+            return {}
+        names = [pin.name for pin in self._get_button_inputs()[:4]]
+        buttons = {}
+        for direction in ('up', 'down', 'left', 'right'):
+            name = next((n for n in names if direction in n.lower()), None)
+            if name:
+                buttons[direction] = name
+        return buttons
+    
+    def _oled_size(self) -> Tuple[int, int]:
+        """OLED_WIDTH x OLED_HEIGHT from the C #defines, 128 x 64 if unset"""
+        defines = self.info['defines']
+        size = []
+        for name, default in (('OLED_WIDTH', 128), ('OLED_HEIGHT', 64)):
+            try:
+                size.append(int(defines.get(name, str(default)), 0))
+            except ValueError:
+                size.append(default)
+        return size[0], size[1]
+    
+    def _power_assignments(self):
         power_pins = [p for p in self.pins if p.is_power]
         if not power_pins:
-            return ""
+            return
         
-        assigns = []
-        assigns.append("    // Power pin assignments")
+        self.ir.section()
+        self.ir.comment("    // Power pin assignments")
         for pin in power_pins:
             if 'vcc' in pin.name.lower() or 'vdd' in pin.name.lower():
-                assigns.append(f"    assign {pin.name} = 1'b1;")
+                self.ir.assign(pin.name, "1'b1")
             elif 'gnd' in pin.name.lower():
-                assigns.append(f"    assign {pin.name} = 1'b0;")
-        
-        return '\n'.join(assigns)
-    
-    def _clock_reset(self) -> str:
-        always = []
-        always.append("    // ============================================")
-        always.append("    // Clock and Reset Logic")
-        always.append("    // ============================================")
-        always.append("    always @(posedge clk or negedge rst_n) begin")
-        always.append("        if (!rst_n) begin")
-        always.append("            // Reset all registers")
-        always.append("            counter <= 32'd0;")
-        always.append("            current_state <= 8'd0;")
-        always.append("            timer_counter <= 32'd0;")
-        always.append("            busy_flag <= 1'b0;")
-        
-        # Reset OLED
-        if self.info['has_oled']:
-            always.append("            pixel_x <= OLED_WIDTH / 2;")
-            always.append("            pixel_y <= OLED_HEIGHT / 2;")
-            always.append("            old_pixel_x <= OLED_WIDTH / 2;")
-            always.append("            old_pixel_y <= OLED_HEIGHT / 2;")
-            always.append("            cursor_inverted <= 1'b0;")
-            always.append("            current_screen <= 2'b00;")
-            always.append("            a_button_was_pressed <= 1'b0;")
-            always.append("            // Clear framebuffer")
-            always.append("            for (integer i = 0; i < 1024; i = i + 1) begin")
-            always.append("                framebuffer[i] <= 8'h00;")
-            always.append("            end")
-        
-        # Reset I2C
-        if self.info['has_i2c']:
-            i2c_pins = [p for p in self.pins if p.is_i2c]
-            always.append("            i2c_address <= 7'h3C;")
-            always.append("            i2c_data_out <= 8'h00;")
-            always.append("            i2c_write_active <= 1'b0;")
-            always.append("            i2c_bit_counter <= 3'd7;")
-            always.append("            i2c_state <= 3'd0;")
-            always.append("            i2c_clk_div <= 9'd0;")
-            for pin in i2c_pins:
-                always.append(f"            {pin.name} <= 1'b1;")  # I2C idle high
-        
-        # Reset button debouncing
-        if self.info['has_buttons']:
-            button_inputs = self._get_button_inputs()
-            for pin in button_inputs[:8]:
-                always.append(f"            {pin.name}_debounced <= 1'b0;")
-                always.append(f"            {pin.name}_debounce_counter <= 16'd0;")
-        
-        always.append("        end else begin")
-        always.append("            // Normal operation")
-        always.append("            counter <= counter + 1;")
-        always.append("            current_state <= next_state;")
-        always.append("            ")
-        always.append("            // Decrement timer")
-        always.append("            if (timer_counter > 0) begin")
-        always.append("                timer_counter <= timer_counter - 1;")
-        always.append("            end")
-        always.append("        end")
-        always.append("    end")
-        
-        return '\n'.join(always)
-    
-    def _button_debouncing(self) -> str:
+                self.ir.assign(pin.name, "1'b0")
+    
+    def _clock_reset(self):
+        self.ir.section()
+        self.ir.comment("""    // ============================================
+    // Clock and Reset Logic
+    // ============================================""")
+        self.ir.always(f"""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            // Every other register is reset by the block that drives it
+            current_state <= {self.ir.lit('current_state', 0)};
+        end else begin
+            current_state <= next_state;
+        end
+    end""", drives=['current_state'], reads=['next_state'])
+        self.ir.comment("    \n    // Free-running cycle counter")
+        self.ir.always("""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            counter <= 32'd0;
+        end else begin
+            counter <= counter + 1;
+        end
+    end""", drives=['counter'], reads=['counter'])
+    
+    def _button_debouncing(self):
         button_inputs = self._get_button_inputs()
         if not button_inputs:
-            return ""
+            return
         
         # Only generate for first few buttons to avoid excessive code
         button_inputs = button_inputs[:8]
         
-        blocks = []
-        blocks.append("    // ============================================")
-        blocks.append("    // Button Debouncing")
-        blocks.append("    // ============================================")
+        self.ir.section()
+        self.ir.comment("""    // ============================================
+    // Button Debouncing
+    // ============================================""")
         
+        source = f" ({self.debounce_timer.source})" if self.debounce_timer else ''
         for pin in button_inputs:
-            blocks.append(f"""
-    // Debounce {pin.name}
-    always @(posedge clk or negedge rst_n) begin
+            self.ir.keep(f"{pin.name}_debounced")
+            self.ir.comment(f"\n    // Debounce {pin.name}: follows once stable for {self.debounce_us} us{source}")
+            count = f"{pin.name}_debounce_counter"
+            zero = self.ir.lit(count, 0)
+            # Starts at the released level so reset is not seen as a press
+            idle = "1'b1" if pin.mode == 'INPUT_PULLUP' else "1'b0"
+            self.ir.always(f"""    always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            {pin.name}_debounced <= 1'b0;
-            {pin.name}_debounce_counter <= 16'd0;
+            {pin.name}_debounced <= {idle};
+            {count} <= {zero};
         end else begin
             if ({pin.name} != {pin.name}_debounced) begin
-                if ({pin.name}_debounce_counter < 16'd5000) begin
-                    {pin.name}_debounce_counter <= {pin.name}_debounce_counter + 1;
+                if ({count} < {self.ir.lit(count, self.debounce_us)}) begin
+                    if (us_tick) {count} <= {count} + {self.ir.lit(count, 1)};
                 end else begin
                     {pin.name}_debounced <= {pin.name};
-                    {pin.name}_debounce_counter <= 16'd0;
+                    {count} <= {zero};
                 end
             end else begin
-                {pin.name}_debounce_counter <= 16'd0;
+                {count} <= {zero};
             end
         end
-    end""")
-        
-        return '\n'.join(blocks)
+    end""", drives=[f"{pin.name}_debounced", f"{pin.name}_debounce_counter"],
+                reads=[pin.name, f"{pin.name}_debounced", count, 'us_tick'])
     
-    def _state_machine(self) -> str:
-        return """    // ============================================
-    // Main State Machine
+    def _us_prescaler(self):
+        """1 us tick shared by the timer tick generators and button debouncers"""
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // Microsecond Prescaler
     // ============================================
-    localparam [7:0]
-        STATE_IDLE     = 8'd0,
-        STATE_INIT     = 8'd1,
-        STATE_RUN      = 8'd2,
-        STATE_WAIT     = 8'd3;
+    // Exact for whole-MHz CLK_HZ""")
+        ir.text("    localparam US_CYCLES = CLK_HZ / 1000000;")
+        ir.reg('us_count', '$clog2(US_CYCLES + 1)-1')
+        ir.wire('us_tick', init="(us_count == US_CYCLES - 1)", reads=['us_count'])
+        ir.comment("    ")
+        ir.always("""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            us_count <= 0;
+        end else if (us_tick) begin
+            us_count <= 0;
+        end else begin
+            us_count <= us_count + 1;
+        end
+    end""", drives=['us_count'], reads=['us_count', 'us_tick'])
     
-    always @(*) begin
+    def _timer_ticks(self):
+        """One tick generator per constant-period timer, all counting the
+        shared 1 us prescaler; each counter is just wide enough for its period"""
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // Timer Tick Generators (from C timer periods)
+    // ============================================""")
+        for t in self.timers:
+            n = t.name
+            ir.keep(f"{n}_tick")
+            bits = max(1, (t.period_us - 1).bit_length())
+            last = f"{bits}'d{t.period_us - 1}"
+            if t.periodic:
+                ir.comment(f"\n    // {n}: every {t.period_us} us, free-running ({t.source})")
+                ir.reg(f"{n}_us", bits - 1)
+                ir.wire(f"{n}_tick", init=f"us_tick && ({n}_us == {last})", reads=['us_tick', f"{n}_us"])
+                ir.comment("    ")
+                ir.always(f"""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            {n}_us <= {bits}'d0;
+        end else if (us_tick) begin
+            {n}_us <= ({n}_us == {last}) ? {bits}'d0 : {n}_us + 1;
+        end
+    end""", drives=[f"{n}_us"], reads=['us_tick', f"{n}_us"])
+            else:
+                ir.comment(f"\n    // {n}: one-shot {t.period_us} us, armed out of reset ({t.source})")
+                ir.reg(f"{n}_armed")
+                ir.reg(f"{n}_us", bits - 1)
+                ir.wire(f"{n}_tick", init=f"{n}_armed && us_tick && ({n}_us == {last})",
+                        reads=[f"{n}_armed", 'us_tick', f"{n}_us"])
+                ir.comment("    ")
+                ir.always(f"""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            {n}_armed <= 1'b1;
+            {n}_us <= {bits}'d0;
+        end else if ({n}_tick) begin
+            {n}_armed <= 1'b0;
+        end else if ({n}_armed && us_tick) begin
+            {n}_us <= {n}_us + 1;
+        end
+    end""", drives=[f"{n}_armed", f"{n}_us"], reads=[f"{n}_tick", f"{n}_armed", 'us_tick', f"{n}_us"])
+    
+    STATES = ('IDLE', 'INIT', 'RUN', 'WAIT')
+    DEBOUNCE_US = 100           # Input stable this long before the debounced level follows,
+                                # unless the C code has its own debounce timer
+    
+    def _state_localparams(self) -> str:
+        names = [f"        STATE_{s:<9}= {self.ir.lit('current_state', i)}" for i, s in enumerate(self.STATES)]
+        return f"    localparam{self.ir.bits('current_state')}\n" + ',\n'.join(names) + ';'
+    
+    def _state_machine(self):
+        if self.timed:
+            return self._timed_state_machine()
+        self.ir.section()
+        self.ir.comment("""    // ============================================
+    // Main State Machine
+    // ============================================""")
+        self.ir.text(self._state_localparams())
+        self.ir.comment("    ")
+        zero = self.ir.lit('timer_counter', 0)
+        self.ir.always(f"""    always @(*) begin
         next_state = current_state;
-        busy_flag = 1'b0;
         
         case (current_state)
             STATE_IDLE: begin
@@ -440,21 +1851,19 @@ class PerfectedGenerator:
             end
             
             STATE_INIT: begin
-                busy_flag = 1'b1;
-                if (timer_counter == 0) begin
+                if (timer_counter == {zero}) begin
                     next_state = STATE_RUN;
                 end
             end
             
             STATE_RUN: begin
-                busy_flag = 1'b1;
                 if (counter[23] == 1'b1) begin
                     next_state = STATE_WAIT;
                 end
             end
             
             STATE_WAIT: begin
-                if (timer_counter == 0) begin
+                if (timer_counter == {zero}) begin
                     next_state = STATE_RUN;
                 end
             end
@@ -463,134 +1872,1484 @@ class PerfectedGenerator:
                 next_state = STATE_IDLE;
             end
         endcase
-    end
-    
-    // Timer control logic
-    always @(posedge clk or negedge rst_n) begin
+    end""", drives=['next_state'], reads=['current_state', 'counter', 'timer_counter'])
+        self.ir.comment("    \n    // Timer control logic")
+        self.ir.always(f"""    always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            timer_counter <= 32'd0;
+            timer_counter <= {zero};
         end else begin
             case (current_state)
-                STATE_INIT: timer_counter <= 32'd1000000;
-                STATE_WAIT: timer_counter <= 32'd500000;
-                default: if (timer_counter > 0) timer_counter <= timer_counter - 1;
+                STATE_INIT: timer_counter <= {self.ir.lit('timer_counter', 1000000)};
+                STATE_WAIT: timer_counter <= {self.ir.lit('timer_counter', 500000)};
+                default: if (timer_counter > {zero}) timer_counter <= timer_counter - {self.ir.lit('timer_counter', 1)};
             endcase
         end
-    end"""
+    end""", drives=['timer_counter'], reads=['current_state', 'timer_counter'])
     
-    def _oled_logic(self) -> str:
-        logic = []
-        logic.append("    // ============================================")
-        logic.append("    // OLED Display Logic")
-        logic.append("    // ============================================")
-        
-        # Create wires for button inputs
-        if self.info['has_buttons']:
-            button_inputs = self._get_button_inputs()
-            logic.append("    ")
-            logic.append("    // Button inputs for cursor control")
-            for pin in button_inputs[:4]:  # Up, Down, Left, Right
-                logic.append(f"    wire {pin.name}_pressed = {pin.name}_debounced;")
-            logic.append("    ")
-        
-        logic.append("""
-    // Cursor movement
-    always @(posedge clk or negedge rst_n) begin
-        if (!rst_n) begin
-            // Initial positions set in reset
-        end else begin
-            // Update old position
-            old_pixel_x <= pixel_x;
-            old_pixel_y <= pixel_y;
-            
-            // Move cursor based on button inputs""")
-        
-        # Add button-based movement if we have buttons
-        if self.info['has_buttons']:
-            button_inputs = self._get_button_inputs()
-            button_names = [pin.name.lower() for pin in button_inputs]
-            
-            if 'up' in ' '.join(button_names):
-                logic.append("            if (Up_pressed && pixel_y > 0) pixel_y <= pixel_y - 1;")
-            if 'down' in ' '.join(button_names):
-                logic.append("            if (Down_pressed && pixel_y < OLED_HEIGHT - 1) pixel_y <= pixel_y + 1;")
-            if 'left' in ' '.join(button_names):
-                logic.append("            if (Left_pressed && pixel_x > 0) pixel_x <= pixel_x - 1;")
-            if 'right' in ' '.join(button_names):
-                logic.append("            if (Right_pressed && pixel_x < OLED_WIDTH - 1) pixel_x <= pixel_x + 1;")
-        else:
-            # Auto-move as fallback
-            logic.append("            // Auto-move (demo)")
-            logic.append("            if (counter[20:0] == 21'h1FFFFF) begin")
-            logic.append("                if (pixel_x < OLED_WIDTH - 1)")
-            logic.append("                    pixel_x <= pixel_x + 1;")
-            logic.append("                else")
-            logic.append("                    pixel_x <= 0;")
-            logic.append("            end")
-        
-        logic.append("        end")
-        logic.append("    end")
-        logic.append("    ")
-        logic.append("""
-    // Framebuffer update
-    always @(posedge clk or negedge rst_n) begin
-        if (!rst_n) begin
-            // Framebuffer cleared in reset
-        end else if (pixel_x != old_pixel_x || pixel_y != old_pixel_y) begin
-            // Calculate indices
-            integer page = pixel_y >> 3;
-            integer bit_pos = pixel_y[2:0];
-            integer idx = page * OLED_WIDTH + pixel_x;
-            
-            integer old_page = old_pixel_y >> 3;
-            integer old_bit = old_pixel_y[2:0];
-            integer old_idx = old_page * OLED_WIDTH + old_pixel_x;
-            
-            // Update framebuffer
-            framebuffer[old_idx] <= framebuffer[old_idx] & ~(1 << old_bit);
-            framebuffer[idx] <= framebuffer[idx] | (1 << bit_pos);
-        end
-    end""")
-        
-        return '\n'.join(logic)
+    SPI_CLK_DIV = 4             # clk cycles per SCK half period
+    SD_INIT_SCK_HZ = 400000
     
-    def _i2c_logic(self) -> str:
-        logic = []
-        logic.append("    // ============================================")
-        logic.append("    // I2C Interface Logic")
-        logic.append("    // ============================================")
+    def _spi_masters(self):
+        """One SPI master per bit-banged bus; other logic queues bytes through
+        <bus>_tx_* (valid/ready) and picks up received bytes on <bus>_rx_*"""
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // SPI Masters (from bit-banged SPI helpers)
+    // ============================================""")
         
-        logic.append("""
-    // I2C State Definitions
-    localparam [2:0]
-        I2C_IDLE      = 3'd0,
-        I2C_START     = 3'd1,
-        I2C_ADDR      = 3'd2,
-        I2C_DATA      = 3'd3,
-        I2C_STOP      = 3'd4;
+        for bus in self.spi_buses:
+            n = bus.name
+            pins = ' '.join(f"{role}={pin}" for role, pin in
+                             (('SCK', bus.sck), ('MOSI', bus.mosi), ('MISO', bus.miso),
+                              ('CS', bus.cs), ('DC', bus.dc)) if pin)
+            order = "MSB" if bus.msb_first else "LSB"
+            ir.keep(f"{n}_tx_ready", f"{n}_rx_data", f"{n}_rx_valid", f"{n}_busy")
+            sd = self.sd and self.sd.bus == n
+            ir.comment(f"\n    // {n}: {pins}; mode 0, {order} first, one byte per 8 SCK cycles")
+            ir.text(f"    parameter {n.upper()}_CLK_DIV = {self.SPI_CLK_DIV};     // SCK = clk / (2 * {n.upper()}_CLK_DIV)")
+            if self.display and self.display.bus == n:
+                ir.comment("    // Transmit side driven by the display sequencer")
+                ir.wire(f"{n}_tx_data", 7)
+                ir.wire(f"{n}_tx_dc")
+                ir.wire(f"{n}_tx_valid")
+            elif sd:
+                ir.text(f"    parameter {n.upper()}_SLOW_DIV = CLK_HZ / {2 * self.SD_INIT_SCK_HZ};     "
+                        f"// {self.SD_INIT_SCK_HZ // 1000} kHz SCK during card init")
+                ir.comment("    // Transmit side and CS control driven by the SD controller")
+                ir.wire(f"{n}_tx_data", 7)
+                ir.wire(f"{n}_tx_dc", init="1'b0")
+                ir.wire(f"{n}_tx_valid")
+                ir.wire(f"{n}_slow")
+                ir.wire(f"{n}_hold_cs")
+                ir.wire(f"{n}_no_cs")
+            else:
+                ir.keep(f"{n}_tx_data", f"{n}_tx_dc", f"{n}_tx_valid")
+                ir.reg(f"{n}_tx_data", 7, init="8'd0")
+                ir.reg(f"{n}_tx_dc", init="1'b0")
+                ir.reg(f"{n}_tx_valid", init="1'b0")
+            ir.wire(f"{n}_tx_ready")
+            ir.wire(f"{n}_rx_data", 7)
+            ir.wire(f"{n}_rx_valid")
+            ir.wire(f"{n}_busy")
+            ir.comment("    ")
+            ir.instance(f"{self.module_name}_spi_master", f"{n}_master", [
+                ('CLK_DIV', f"{n.upper()}_CLK_DIV"),
+                ('SLOW_DIV', f"{n.upper()}_{'SLOW' if sd else 'CLK'}_DIV"),
+                ('FIFO_BITS', '4'),
+                ('LSB_FIRST', '0' if bus.msb_first else '1'),
+            ], [
+                ('clk', 'clk', 'in'),
+                ('rst_n', 'rst_n', 'in'),
+                ('tx_data', f"{n}_tx_data", 'in'),
+                ('tx_dc', f"{n}_tx_dc", 'in'),
+                ('tx_valid', f"{n}_tx_valid", 'in'),
+                ('tx_ready', f"{n}_tx_ready", 'out'),
+                ('rx_data', f"{n}_rx_data", 'out'),
+                ('rx_valid', f"{n}_rx_valid", 'out'),
+                ('busy', f"{n}_busy", 'out'),
+                ('slow', f"{n}_slow" if sd else "1'b0", 'in'),
+                ('hold_cs', f"{n}_hold_cs" if sd else "1'b0", 'in'),
+                ('no_cs', f"{n}_no_cs" if sd else "1'b0", 'in'),
+                ('sck', bus.sck, 'out'),
+                ('mosi', bus.mosi or '', 'out'),
+                ('cs_n', bus.cs or '', 'out'),
+                ('dc', bus.dc or '', 'out'),
+                ('miso', bus.miso or "1'b1", 'in'),
+            ])
     
-    // I2C clock enable for 100kHz (assuming 50MHz system clock)
-    assign i2c_clk_enable = (i2c_clk_div == 9'd249);
+    def _spi_master_module(self) -> str:
+        return f"""// ============================================================
+// SPI master, mode 0, with a byte FIFO and valid/ready interface.
+// Bytes queued back to back keep CS low; each byte takes 16 * CLK_DIV
+// clocks (SLOW_DIV while slow is set) and the byte clocked in meanwhile
+// comes out on rx_data. hold_cs keeps CS low between transfers, no_cs
+// shifts with CS high (SD card power-up clocks).
+// ============================================================
+module {self.module_name}_spi_master #(
+    parameter CLK_DIV = 4,          // clk cycles per SCK half period
+    parameter SLOW_DIV = 4,         // Same, while slow is set
+    parameter FIFO_BITS = 4,        // FIFO depth = 2**FIFO_BITS bytes
+    parameter LSB_FIRST = 0
+) (
+    input wire clk,
+    input wire rst_n,
+    
+    // Transmit: {{tx_dc, tx_data}} accepted when tx_valid && tx_ready
+    input wire [7:0] tx_data,
+    input wire tx_dc,
+    input wire tx_valid,
+    output wire tx_ready,
+    
+    // Receive: one rx_valid pulse per byte shifted out
+    output reg [7:0] rx_data,
+    output reg rx_valid,
+    output wire busy,
+    
+    // Clock and chip select control, sampled as each byte starts
+    input wire slow,
+    input wire hold_cs,
+    input wire no_cs,
+    
+    // SPI pins
+    output reg sck,
+    output reg mosi,
+    output reg cs_n,
+    output reg dc,
+    input wire miso
+);
+    localparam DEPTH = 1 << FIFO_BITS;
+    localparam MAX_DIV = (SLOW_DIV > CLK_DIV) ? SLOW_DIV : CLK_DIV;
+    localparam DIV_BITS = $clog2(MAX_DIV + 1);
+    
+    // FIFO of {{dc, data}}, storage without reset so it maps to distributed RAM
+    reg [8:0] fifo [0:DEPTH-1];
+    reg [FIFO_BITS:0] wr_ptr;
+    reg [FIFO_BITS:0] rd_ptr;
+    wire fifo_empty = (wr_ptr == rd_ptr);
+    wire fifo_full = (wr_ptr == {{~rd_ptr[FIFO_BITS], rd_ptr[FIFO_BITS-1:0]}});
+    wire [8:0] fifo_head = fifo[rd_ptr[FIFO_BITS-1:0]];
+    
+    assign tx_ready = !fifo_full;
+    
+    always @(posedge clk) begin
+        if (tx_valid && !fifo_full) begin
+            fifo[wr_ptr[FIFO_BITS-1:0]] <= {{tx_dc, tx_data}};
+        end
+    end
     
-    // I2C clock divider
     always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            i2c_clk_div <= 9'd0;
-        end else begin
-            if (i2c_clk_div == 9'd499) begin
-                i2c_clk_div <= 9'd0;
-            end else begin
-                i2c_clk_div <= i2c_clk_div + 1;
-            end
+            wr_ptr <= 0;
+        end else if (tx_valid && !fifo_full) begin
+            wr_ptr <= wr_ptr + 1;
         end
     end
     
-    // I2C state machine
+    // Shifter: MOSI changes on the falling edge, MISO is sampled on the rising edge
+    reg active;
+    reg [7:0] shift;
+    reg [2:0] bit_count;
+    reg [DIV_BITS-1:0] div;
+    reg slow_byte;
+    wire half_period = (div == (slow_byte ? SLOW_DIV - 1 : CLK_DIV - 1));
+    wire [7:0] next_byte = fifo_head[7:0];
+    
+    assign busy = active || !fifo_empty;
+    
     always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            i2c_state <= I2C_IDLE;
-            i2c_bit_counter <= 3'd7;
+            rd_ptr <= 0;
+            active <= 1'b0;
+            shift <= 8'd0;
+            bit_count <= 3'd0;
+            div <= 0;
+            slow_byte <= 1'b0;
+            rx_data <= 8'd0;
+            rx_valid <= 1'b0;
+            sck <= 1'b0;
+            mosi <= 1'b0;
+            cs_n <= 1'b1;
+            dc <= 1'b0;
+        end else begin
+            rx_valid <= 1'b0;
+            
+            if (!active) begin
+                if (!fifo_empty) begin
+                    // Load: first bit and D/C settle half a period before SCK rises
+                    active <= 1'b1;
+                    shift <= next_byte;
+                    mosi <= LSB_FIRST ? next_byte[0] : next_byte[7];
+                    dc <= fifo_head[8];
+                    cs_n <= no_cs;
+                    slow_byte <= slow;
+                    bit_count <= 3'd0;
+                    div <= 0;
+                    rd_ptr <= rd_ptr + 1;
+                end else begin
+                    cs_n <= !hold_cs;
+                end
+            end else if (!half_period) begin
+                div <= div + 1;
+            end else begin
+                div <= 0;
+                if (!sck) begin
+                    sck <= 1'b1;
+                    shift <= LSB_FIRST ? {{miso, shift[7:1]}} : {{shift[6:0], miso}};
+                end else begin
+                    sck <= 1'b0;
+                    bit_count <= bit_count + 1;
+                    if (bit_count != 3'd7) begin
+                        mosi <= LSB_FIRST ? shift[0] : shift[7];
+                    end else begin
+                        rx_data <= shift;
+                        rx_valid <= 1'b1;
+                        if (!fifo_empty) begin
+                            // Next byte straight away, CS stays low
+                            shift <= next_byte;
+                            mosi <= LSB_FIRST ? next_byte[0] : next_byte[7];
+                            dc <= fifo_head[8];
+                            cs_n <= no_cs;
+                            slow_byte <= slow;
+                            rd_ptr <= rd_ptr + 1;
+                        end else begin
+                            active <= 1'b0;
+                            cs_n <= !hold_cs;
+                        end
+                    end
+                end
+            end
+        end
+    end
+endmodule"""
+    
+    def _display_sequencer(self):
+        """Display sequencer on the display's SPI bus: runs the init table from
+        its ROM after reset, then serves window fills"""
+        d = self.display
+        rom = next(r for r in self.info['roms'] if r.name == d.init_rom)
+        addr_bits = max(1, (len(rom.values) - 1).bit_length())
+        ir = self.ir
+        ir.section()
+        ir.comment(f"""    // ============================================
+    // Display Sequencer (init table + fill engine)
+    // ============================================
+    // Runs {d.init_rom} on {d.bus} after reset; once display_ready, a
+    // display_fill_start pulse fills the inclusive window with one color""")
+        ir.keep('display_fill_start', 'display_fill_x0', 'display_fill_y0', 'display_fill_x1',
+                'display_fill_y1', 'display_fill_color', 'display_ready', 'display_fill_busy')
+        ir.reg('display_fill_start', init="1'b0")
+        ir.reg('display_fill_x0', 15, init="16'd0")
+        ir.reg('display_fill_y0', 15, init="16'd0")
+        ir.reg('display_fill_x1', 15, init=f"16'd{d.width - 1}")
+        ir.reg('display_fill_y1', 15, init=f"16'd{d.height - 1}")
+        ir.reg('display_fill_color', 15, init="16'd0")
+        ir.wire('display_ready')
+        ir.wire('display_fill_busy')
+        ir.comment("    ")
+        params = [
+            ('CLK_HZ', 'CLK_HZ'),
+            ('INIT_LEN', str(len(rom.values))),
+            ('ROM_BITS', str(addr_bits)),
+            ('WIDTH', str(d.width)),
+            ('HEIGHT', str(d.height)),
+            ('MADCTL', f"8'h{d.madctl:02X}"),
+            ('PIXEL_FORMAT', f"8'h{d.pixel_format:02X}"),
+        ]
+        params += [(key, f"8'h{value:02X}") for key, value in d.step_format.items()]
+        params += [(f"OP_{op}", f"8'd{code}") for op, code in d.ops.items()]
+        ir.instance(f"{self.module_name}_display", 'display', params, [
+            ('clk', 'clk', 'in'),
+            ('rst_n', 'rst_n', 'in'),
+            ('rom_addr', f"{d.init_rom}_addr", 'out'),
+            ('rom_data', f"{d.init_rom}_data", 'in'),
+            ('tx_data', f"{d.bus}_tx_data", 'out'),
+            ('tx_dc', f"{d.bus}_tx_dc", 'out'),
+            ('tx_valid', f"{d.bus}_tx_valid", 'out'),
+            ('tx_ready', f"{d.bus}_tx_ready", 'in'),
+            ('spi_busy', f"{d.bus}_busy", 'in'),
+            ('panel_rst', d.rst or '', 'out'),
+            ('ready', 'display_ready', 'out'),
+            ('fill_start', 'display_fill_start', 'in'),
+            ('fill_x0', 'display_fill_x0', 'in'),
+            ('fill_y0', 'display_fill_y0', 'in'),
+            ('fill_x1', 'display_fill_x1', 'in'),
+            ('fill_y1', 'display_fill_y1', 'in'),
+            ('fill_color', 'display_fill_color', 'in'),
+            ('fill_busy', 'display_fill_busy', 'out'),
+        ])
+    
+    def _display_module(self) -> str:
+        return f"""// ============================================================
+// Display command sequencer. The init ROM is microcode steps of
+// cmd, flags, (flags & LEN_MASK) parameters, [delay ms], with PSEUDO
+// marking OP_* operations (any other pseudo cmd only delays). Fills
+// send CASET/PASET/RAMWR and then two bytes per pixel, one FIFO push
+// every other clock, so the SPI master never starves and a clear runs
+// at SPI line rate.
+// ============================================================
+module {self.module_name}_display #(
+    parameter CLK_HZ = 50000000,
+    parameter INIT_LEN = 16,        // Bytes in the init ROM
+    parameter ROM_BITS = 4,
+    parameter WIDTH = 240,
+    parameter HEIGHT = 320,
+    parameter [7:0] MADCTL = 8'h48,
+    parameter [7:0] PIXEL_FORMAT = 8'h55,
+    parameter [7:0] LEN_MASK = 8'h3F,
+    parameter [7:0] PSEUDO = 8'h40,
+    parameter [7:0] DELAY = 8'h80,
+    parameter [7:0] OP_RST_LOW = 8'd0,
+    parameter [7:0] OP_RST_HIGH = 8'd1,
+    parameter [7:0] OP_PIXEL_FORMAT = 8'd2,
+    parameter [7:0] OP_MADCTL = 8'd3
+) (
+    input wire clk,
+    input wire rst_n,
+    
+    // Init ROM, synchronous with one cycle latency
+    output wire [ROM_BITS-1:0] rom_addr,
+    input wire [7:0] rom_data,
+    
+    // SPI master transmit side
+    output wire [7:0] tx_data,
+    output wire tx_dc,
+    output wire tx_valid,
+    input wire tx_ready,
+    input wire spi_busy,
+    
+    output reg panel_rst,
+    output wire ready,
+    
+    // Fill engine: window inside WIDTH x HEIGHT, accepted when ready
+    input wire fill_start,
+    input wire [15:0] fill_x0,
+    input wire [15:0] fill_y0,
+    input wire [15:0] fill_x1,
+    input wire [15:0] fill_y1,
+    input wire [15:0] fill_color,
+    output reg fill_busy
+);
+    localparam MS_TICKS = CLK_HZ / 1000;
+    localparam MS_BITS = $clog2(MS_TICKS + 1);
+    localparam PIXEL_BITS = $clog2(WIDTH * HEIGHT + 1);
+    
+    localparam [3:0]
+        S_CMD    = 4'd0,    // Fetch step command
+        S_FLAGS  = 4'd1,    // Fetch flags, send command or decode pseudo op
+        S_PARAM  = 4'd2,    // Fetch and send parameters
+        S_PSEUDO = 4'd3,
+        S_INLINE = 4'd4,    // Parameter of a pseudo op command
+        S_NEXT   = 4'd5,    // Fetch delay, if any
+        S_DELAY  = 4'd6,
+        S_READY  = 4'd7,
+        S_WINDOW = 4'd8,    // CASET, PASET, RAMWR
+        S_PIXELS = 4'd9,
+        S_PUSH   = 4'd10;   // Hold out_byte until the FIFO takes it
+    
+    reg [3:0] state;
+    reg [3:0] ret;
+    reg [ROM_BITS:0] pc;
+    reg fetched;                // rom_data holds the byte at pc
+    reg [7:0] cmd;
+    reg [7:0] flags;
+    reg [5:0] count;
+    reg [7:0] param;
+    reg [7:0] ms_left;
+    reg [MS_BITS-1:0] ms_tick;
+    reg [7:0] out_byte;
+    reg out_dc;
+    reg [3:0] window_step;
+    reg [15:0] x0, y0, x1, y1;
+    reg [15:0] color;
+    reg [PIXEL_BITS-1:0] pixels_left;
+    reg low_byte;
+    
+    assign rom_addr = pc[ROM_BITS-1:0];
+    assign tx_data = out_byte;
+    assign tx_dc = out_dc;
+    assign tx_valid = (state == S_PUSH);
+    assign ready = (state == S_READY);
+    
+    // Window bytes as {{dc, byte}}, CASET/PASET take big-endian start and end
+    reg [8:0] window_byte;
+    always @(*) begin
+        case (window_step)
+            4'd0: window_byte = {{1'b0, 8'h2A}};
+            4'd1: window_byte = {{1'b1, x0[15:8]}};
+            4'd2: window_byte = {{1'b1, x0[7:0]}};
+            4'd3: window_byte = {{1'b1, x1[15:8]}};
+            4'd4: window_byte = {{1'b1, x1[7:0]}};
+            4'd5: window_byte = {{1'b0, 8'h2B}};
+            4'd6: window_byte = {{1'b1, y0[15:8]}};
+            4'd7: window_byte = {{1'b1, y0[7:0]}};
+            4'd8: window_byte = {{1'b1, y1[15:8]}};
+            4'd9: window_byte = {{1'b1, y1[7:0]}};
+            default: window_byte = {{1'b0, 8'h2C}};
+        endcase
+    end
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            state <= S_CMD;
+            ret <= S_CMD;
+            pc <= 0;
+            fetched <= 1'b0;
+            cmd <= 8'd0;
+            flags <= 8'd0;
+            count <= 6'd0;
+            param <= 8'd0;
+            ms_left <= 8'd0;
+            ms_tick <= 0;
+            out_byte <= 8'd0;
+            out_dc <= 1'b0;
+            window_step <= 4'd0;
+            x0 <= 16'd0;
+            y0 <= 16'd0;
+            x1 <= 16'd0;
+            y1 <= 16'd0;
+            color <= 16'd0;
+            pixels_left <= 0;
+            low_byte <= 1'b0;
+            panel_rst <= 1'b1;
+            fill_busy <= 1'b0;
+        end else begin
+            case (state)
+                S_CMD: begin
+                    if (pc == INIT_LEN) begin
+                        state <= S_READY;
+                    end else if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        cmd <= rom_data;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        state <= S_FLAGS;
+                    end
+                end
+                
+                S_FLAGS: begin
+                    if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        flags <= rom_data;
+                        count <= rom_data & LEN_MASK;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        if (rom_data & PSEUDO) begin
+                            state <= S_PSEUDO;
+                        end else begin
+                            out_byte <= cmd;
+                            out_dc <= 1'b0;
+                            ret <= S_PARAM;
+                            state <= S_PUSH;
+                        end
+                    end
+                end
+                
+                S_PARAM: begin
+                    if (count == 0) begin
+                        state <= S_NEXT;
+                    end else if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        out_byte <= rom_data;
+                        out_dc <= 1'b1;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        count <= count - 1;
+                        ret <= S_PARAM;
+                        state <= S_PUSH;
+                    end
+                end
+                
+                S_PSEUDO: begin
+                    if ((cmd == OP_RST_LOW || cmd == OP_RST_HIGH) && spi_busy) begin
+                        // Reset edges wait for bytes still in the FIFO
+                    end else begin
+                        // Pseudo ops take no ROM parameters, skip any that are there
+                        pc <= pc + count;
+                    end
+                    
+                    if (cmd == OP_RST_LOW || cmd == OP_RST_HIGH) begin
+                        if (!spi_busy) begin
+                            panel_rst <= (cmd == OP_RST_HIGH);
+                            state <= S_NEXT;
+                        end
+                    end else if (cmd == OP_PIXEL_FORMAT || cmd == OP_MADCTL) begin
+                        out_byte <= (cmd == OP_MADCTL) ? 8'h36 : 8'h3A;
+                        out_dc <= 1'b0;
+                        param <= (cmd == OP_MADCTL) ? MADCTL : PIXEL_FORMAT;
+                        ret <= S_INLINE;
+                        state <= S_PUSH;
+                    end else begin
+                        state <= S_NEXT;
+                    end
+                end
+                
+                S_INLINE: begin
+                    out_byte <= param;
+                    out_dc <= 1'b1;
+                    ret <= S_NEXT;
+                    state <= S_PUSH;
+                end
+                
+                S_NEXT: begin
+                    if (!(flags & DELAY)) begin
+                        state <= S_CMD;
+                    end else if (!fetched) begin
+                        fetched <= 1'b1;
+                    end else begin
+                        ms_left <= rom_data;
+                        ms_tick <= 0;
+                        pc <= pc + 1;
+                        fetched <= 1'b0;
+                        state <= S_DELAY;
+                    end
+                end
+                
+                S_DELAY: begin
+                    // Counted from when the step's bytes have left the SPI master
+                    if (spi_busy) begin
+                        ms_tick <= 0;
+                    end else if (ms_left == 0) begin
+                        state <= S_CMD;
+                    end else if (ms_tick == MS_TICKS - 1) begin
+                        ms_tick <= 0;
+                        ms_left <= ms_left - 1;
+                    end else begin
+                        ms_tick <= ms_tick + 1;
+                    end
+                end
+                
+                S_READY: begin
+                    if (fill_start) begin
+                        x0 <= fill_x0;
+                        y0 <= fill_y0;
+                        x1 <= fill_x1;
+                        y1 <= fill_y1;
+                        color <= fill_color;
+                        pixels_left <= (fill_x1 - fill_x0 + 1) * (fill_y1 - fill_y0 + 1);
+                        window_step <= 4'd0;
+                        fill_busy <= 1'b1;
+                        state <= S_WINDOW;
+                    end
+                end
+                
+                S_WINDOW: begin
+                    out_dc <= window_byte[8];
+                    out_byte <= window_byte[7:0];
+                    window_step <= window_step + 1;
+                    low_byte <= 1'b0;
+                    ret <= (window_step == 4'd10) ? S_PIXELS : S_WINDOW;
+                    state <= S_PUSH;
+                end
+                
+                S_PIXELS: begin
+                    if (pixels_left == 0) begin
+                        fill_busy <= 1'b0;
+                        state <= S_READY;
+                    end else begin
+                        out_byte <= low_byte ? color[7:0] : color[15:8];
+                        out_dc <= 1'b1;
+                        low_byte <= !low_byte;
+                        if (low_byte) pixels_left <= pixels_left - 1;
+                        ret <= S_PIXELS;
+                        state <= S_PUSH;
+                    end
+                end
+                
+                S_PUSH: begin
+                    if (tx_ready) state <= ret;
+                end
+                
+                default: state <= S_CMD;
+            endcase
+        end
+    end
+endmodule"""
+    
+    def _sd_controller(self):
+        """SD controller on the card's SPI bus; sectors land in a dual-port
+        buffer whose second port belongs to the rest of the design"""
+        n = self.sd.bus
+        present = f"!{self.sd.cd}" if self.sd.cd else "1'b1"
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // SD Card Controller (SPI mode, sector reads)
+    // ============================================
+    // Initializes the card whenever one is present; once sd_ready, a
+    // sd_read_start pulse loads sd_read_sector into the sector buffer,
+    // read back through sd_buf_addr / sd_buf_data (one cycle latency)""")
+        ir.keep('sd_read_start', 'sd_read_sector', 'sd_buf_addr', 'sd_buf_data', 'sd_ready',
+                'sd_read_done', 'sd_read_error', 'sd_init_error')
+        ir.reg('sd_read_start', init="1'b0")
+        ir.reg('sd_read_sector', 31, init="32'd0")
+        ir.reg('sd_buf_addr', 8, init="9'd0")
+        ir.wire('sd_buf_data', 7)
+        ir.wire('sd_ready')
+        ir.wire('sd_read_done')
+        ir.wire('sd_read_error')
+        ir.wire('sd_init_error')
+        ir.comment("    ")
+        ir.instance(f"{self.module_name}_sd", 'sd', [('CLK_HZ', 'CLK_HZ')], [
+            ('clk', 'clk', 'in'),
+            ('rst_n', 'rst_n', 'in'),
+            ('card_present', present, 'in'),
+            ('tx_data', f"{n}_tx_data", 'out'),
+            ('tx_valid', f"{n}_tx_valid", 'out'),
+            ('tx_ready', f"{n}_tx_ready", 'in'),
+            ('rx_data', f"{n}_rx_data", 'in'),
+            ('rx_valid', f"{n}_rx_valid", 'in'),
+            ('slow', f"{n}_slow", 'out'),
+            ('hold_cs', f"{n}_hold_cs", 'out'),
+            ('no_cs', f"{n}_no_cs", 'out'),
+            ('ready', 'sd_ready', 'out'),
+            ('init_error', 'sd_init_error', 'out'),
+            ('read_start', 'sd_read_start', 'in'),
+            ('read_sector', 'sd_read_sector', 'in'),
+            ('read_done', 'sd_read_done', 'out'),
+            ('read_error', 'sd_read_error', 'out'),
+            ('buf_addr', 'sd_buf_addr', 'in'),
+            ('buf_data', 'sd_buf_data', 'out'),
+        ])
+    
+    def _uart_transmitters(self):
+        """One 8N1 transmitter per UART TX pin; other logic hands it bytes
+        through <uart>_tx_data / _tx_valid when <uart>_tx_ready"""
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // UART Transmitters (from uart_init configs)
+    // ============================================""")
+        for uart in self.uarts:
+            n = uart.name
+            ir.keep(f"{n}_tx_data", f"{n}_tx_valid", f"{n}_tx_ready")
+            ir.comment(f"\n    // {n}: TX={uart.tx}, 8N1 at {uart.source}; the line idles high")
+            ir.text(f"    parameter {n.upper()}_BAUD = {uart.baud};")
+            ir.reg(f"{n}_tx_data", 7, init="8'd0")
+            ir.reg(f"{n}_tx_valid", init="1'b0")
+            ir.wire(f"{n}_tx_ready")
+            ir.comment("    ")
+            ir.instance(f"{self.module_name}_uart_tx", f"{n}_tx", [
+                ('CLK_HZ', 'CLK_HZ'),
+                ('BAUD', f"{n.upper()}_BAUD"),
+            ], [
+                ('clk', 'clk', 'in'),
+                ('rst_n', 'rst_n', 'in'),
+                ('tx_data', f"{n}_tx_data", 'in'),
+                ('tx_valid', f"{n}_tx_valid", 'in'),
+                ('tx_ready', f"{n}_tx_ready", 'out'),
+                ('tx', uart.tx, 'out'),
+            ])
+    
+    def _uart_tx_module(self) -> str:
+        return f"""// ============================================================
+// UART transmitter, 8N1, LSB first. A byte is taken on tx_valid while
+// tx_ready; the line is high out of reset and between frames
+// ============================================================
+module {self.module_name}_uart_tx #(
+    parameter CLK_HZ = 50000000,
+    parameter BAUD = 115200
+) (
+    input wire clk,
+    input wire rst_n,
+    input wire [7:0] tx_data,
+    input wire tx_valid,
+    output wire tx_ready,
+    output reg tx
+);
+    localparam BIT_CYCLES = CLK_HZ / BAUD;
+    
+    reg [$clog2(BIT_CYCLES + 1)-1:0] baud_count;
+    reg [3:0] bit_index;            // 0 idle, 1 start, 2..9 data, 10 stop
+    reg [8:0] shift;                // Data bits still to send, then the stop bit
+    
+    assign tx_ready = (bit_index == 4'd0);
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            tx <= 1'b1;
+            baud_count <= 0;
+            bit_index <= 4'd0;
+            shift <= 9'h1FF;
+        end else if (bit_index == 4'd0) begin
+            if (tx_valid) begin
+                tx <= 1'b0;         // Start bit
+                shift <= {{1'b1, tx_data}};
+                baud_count <= 0;
+                bit_index <= 4'd1;
+            end
+        end else if (baud_count == BIT_CYCLES - 1) begin
+            baud_count <= 0;
+            if (bit_index == 4'd10) begin
+                bit_index <= 4'd0;  // Stop bit sent
+            end else begin
+                tx <= shift[0];
+                shift <= {{1'b1, shift[8:1]}};
+                bit_index <= bit_index + 1;
+            end
+        end else begin
+            baud_count <= baud_count + 1;
+        end
+    end
+endmodule"""
+    
+    def _idle_outputs(self):
+        """Output pins no generated logic drives are tied to their idle level
+        instead of floating: the last constant the C code writes, else high
+        for pins it starts high or pulls up"""
+        idle = [p for p in self.pins if p.direction == 'output' and p.name in self.ir.undriven_outputs()]
+        if not idle:
+            return
+        self.ir.section()
+        self.ir.comment("    // Outputs with no generated logic, held at their idle level")
+        for pin in idle:
+            level = pin.level or ("1'b1" if pin.mode in ('OUTPUT_HIGH', 'INPUT_PULLUP') else "1'b0")
+            self.ir.retype(pin.name, 'output wire')
+            self.ir.assign(pin.name, level)
+    
+    def _sd_module(self) -> str:
+        return f"""// ============================================================
+// SD card controller, SPI mode. Power-up clocks and CMD0 / CMD8 /
+// ACMD41 run on the slow SPI clock, CMD58 picks block or byte
+// addressing, then CMD17 reads a sector into a 512-byte dual-port
+// buffer. One byte is in flight at a time: responses decide what is
+// sent next, and the wait for each rx byte costs a few clocks per
+// 16 * CLK_DIV.
+// ============================================================
+module {self.module_name}_sd #(
+    parameter CLK_HZ = 50000000,
+    parameter INIT_TIMEOUT_MS = 1000,   // ACMD41 busy limit
+    parameter TOKEN_TRIES = 10000       // Bytes polled for the data token
+) (
+    input wire clk,
+    input wire rst_n,
+    input wire card_present,
+    
+    // SPI master, mode 0
+    output reg [7:0] tx_data,
+    output wire tx_valid,
+    input wire tx_ready,
+    input wire [7:0] rx_data,
+    input wire rx_valid,
+    output reg slow,
+    output reg hold_cs,
+    output reg no_cs,
+    
+    output wire ready,
+    output reg init_error,
+    
+    // Sector reads, read_done or read_error pulses when finished
+    input wire read_start,
+    input wire [31:0] read_sector,
+    output reg read_done,
+    output reg read_error,
+    
+    // Sector buffer read port
+    input wire [8:0] buf_addr,
+    output reg [7:0] buf_data
+);
+    localparam MS_TICKS = CLK_HZ / 1000;
+    localparam MS_BITS = $clog2(MS_TICKS + 1);
+    
+    // Command states issue a command; the state named after the next
+    // command receives the R1 of the previous one in r1
+    localparam [4:0]
+        S_ABSENT    = 5'd0,     // No card
+        S_POWER     = 5'd1,     // 80 clocks with CS high
+        S_CMD0      = 5'd2,
+        S_CMD8      = 5'd3,
+        S_CMD55     = 5'd4,
+        S_ACMD41    = 5'd5,
+        S_ACMD41_R  = 5'd6,
+        S_OCR       = 5'd7,     // R1 of CMD58, OCR follows
+        S_CCS       = 5'd8,     // First OCR byte, CCS in bit 6
+        S_READY     = 5'd9,
+        S_CMD17     = 5'd10,
+        S_TOKEN     = 5'd11,
+        S_TOKEN_R   = 5'd12,
+        S_DATA      = 5'd13,
+        S_DATA_W    = 5'd14,    // Store rx at count
+        S_CRC       = 5'd15,
+        S_RELEASE   = 5'd16,    // CS high plus 8 clocks, then rel_ret
+        S_DONE      = 5'd17,
+        S_ERROR     = 5'd18,
+        C_SEND      = 5'd19,    // Command subroutine: 6 command bytes
+        C_POLL      = 5'd20,    //   then up to 10 bytes for R1
+        X_PUSH      = 5'd21,    // Byte subroutine: send tx_data
+        X_WAIT      = 5'd22;    //   and wait for the byte shifted in
+    
+    reg [4:0] state;
+    reg [4:0] xfer_ret;
+    reg [4:0] cmd_ret;
+    reg [4:0] rel_ret;
+    reg [7:0] rx;
+    reg [5:0] cmd_index;
+    reg [31:0] cmd_arg;
+    reg [7:0] cmd_crc;
+    reg [9:0] count;
+    reg [13:0] tries;
+    reg [7:0] r1;
+    reg block_addr;             // SDHC/SDXC: CMD17 takes a block number
+    reg [MS_BITS-1:0] ms_tick;
+    reg [15:0] ms_count;
+    reg read_fail;
+    
+    assign tx_valid = (state == X_PUSH);
+    assign ready = (state == S_READY);
+    
+    // Sector buffer: written by the controller, read on the other port
+    reg [7:0] sector_buf [0:511];
+    
+    always @(posedge clk) begin
+        if (state == S_DATA_W) begin
+            sector_buf[count[8:0]] <= rx;
+        end
+    end
+    
+    always @(posedge clk) begin
+        buf_data <= sector_buf[buf_addr];
+    end
+    
+    // Milliseconds since CMD0, for the ACMD41 timeout
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            ms_tick <= 0;
+            ms_count <= 16'd0;
+        end else if (state == S_CMD0) begin
+            ms_tick <= 0;
+            ms_count <= 16'd0;
+        end else if (ms_tick == MS_TICKS - 1) begin
+            ms_tick <= 0;
+            if (ms_count != 16'hFFFF) ms_count <= ms_count + 1;
+        end else begin
+            ms_tick <= ms_tick + 1;
+        end
+    end
+    
+    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            state <= S_ABSENT;
+            xfer_ret <= S_ABSENT;
+            cmd_ret <= S_ABSENT;
+            rel_ret <= S_ABSENT;
+            tx_data <= 8'hFF;
+            rx <= 8'hFF;
+            cmd_index <= 6'd0;
+            cmd_arg <= 32'd0;
+            cmd_crc <= 8'h00;
+            count <= 10'd0;
+            tries <= 14'd0;
+            r1 <= 8'hFF;
+            block_addr <= 1'b0;
+            read_fail <= 1'b0;
+            slow <= 1'b1;
+            hold_cs <= 1'b0;
+            no_cs <= 1'b0;
+            init_error <= 1'b0;
+            read_done <= 1'b0;
+            read_error <= 1'b0;
+        end else begin
+            read_done <= 1'b0;
+            read_error <= 1'b0;
+            
+            // A byte in flight always finishes so its rx_valid is not mistaken later
+            if (!card_present && state != X_WAIT) begin
+                state <= S_ABSENT;
+                hold_cs <= 1'b0;
+                slow <= 1'b1;
+                block_addr <= 1'b0;
+                init_error <= 1'b0;
+                count <= 10'd0;
+                tries <= 14'd0;
+            end else begin
+                case (state)
+                    S_ABSENT: begin
+                        state <= S_POWER;
+                    end
+                    
+                    S_POWER: begin
+                        if (count == 10'd10) begin
+                            no_cs <= 1'b0;
+                            count <= 10'd0;
+                            state <= S_CMD0;
+                        end else begin
+                            no_cs <= 1'b1;
+                            tx_data <= 8'hFF;
+                            count <= count + 1;
+                            xfer_ret <= S_POWER;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    S_CMD0: begin
+                        cmd_index <= 6'd0;
+                        cmd_arg <= 32'd0;
+                        cmd_crc <= 8'h95;
+                        cmd_ret <= S_CMD8;
+                        rel_ret <= C_SEND;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_CMD8: begin
+                        if (r1 != 8'h01) begin
+                            // Not idle yet, CMD0 again a few times
+                            tries <= tries + 1;
+                            state <= (tries == 14'd9) ? S_ERROR : S_CMD0;
+                        end else begin
+                            tries <= 14'd0;
+                            cmd_index <= 6'd8;
+                            cmd_arg <= 32'h000001AA;
+                            cmd_crc <= 8'h87;
+                            cmd_ret <= S_CMD55;
+                            rel_ret <= C_SEND;
+                            state <= S_RELEASE;
+                        end
+                    end
+                    
+                    S_CMD55: begin
+                        // CMD8 is an illegal command on v1 cards, which still init
+                        cmd_index <= 6'd55;
+                        cmd_arg <= 32'd0;
+                        cmd_crc <= 8'h01;
+                        cmd_ret <= S_ACMD41;
+                        rel_ret <= C_SEND;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_ACMD41: begin
+                        cmd_index <= 6'd41;
+                        cmd_arg <= 32'h40000000;     // HCS: host supports SDHC
+                        cmd_crc <= 8'h01;
+                        cmd_ret <= S_ACMD41_R;
+                        rel_ret <= C_SEND;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_ACMD41_R: begin
+                        if (r1 == 8'h00) begin
+                            cmd_index <= 6'd58;
+                            cmd_arg <= 32'd0;
+                            cmd_crc <= 8'h01;
+                            cmd_ret <= S_OCR;
+                            rel_ret <= C_SEND;
+                            state <= S_RELEASE;
+                        end else if (ms_count >= INIT_TIMEOUT_MS) begin
+                            state <= S_ERROR;
+                        end else begin
+                            state <= S_CMD55;
+                        end
+                    end
+                    
+                    S_OCR: begin
+                        if (r1 == 8'h00) begin
+                            tx_data <= 8'hFF;
+                            xfer_ret <= S_CCS;
+                            state <= X_PUSH;
+                        end else begin
+                            // No OCR, byte addressing as for SDSC
+                            block_addr <= 1'b0;
+                            slow <= 1'b0;
+                            rel_ret <= S_READY;
+                            state <= S_RELEASE;
+                        end
+                    end
+                    
+                    S_CCS: begin
+                        block_addr <= rx[6];
+                        slow <= 1'b0;
+                        rel_ret <= S_READY;
+                        state <= S_RELEASE;
+                    end
+                    
+                    S_READY: begin
+                        if (read_start) begin
+                            cmd_index <= 6'd17;
+                            cmd_arg <= block_addr ? read_sector : {{read_sector[22:0], 9'd0}};
+                            cmd_crc <= 8'h01;
+                            cmd_ret <= S_CMD17;
+                            count <= 10'd0;
+                            state <= C_SEND;
+                        end
+                    end
+                    
+                    S_CMD17: begin
+                        tries <= 14'd0;
+                        if (r1 != 8'h00) begin
+                            read_fail <= 1'b1;
+                            rel_ret <= S_DONE;
+                            state <= S_RELEASE;
+                        end else begin
+                            state <= S_TOKEN;
+                        end
+                    end
+                    
+                    S_TOKEN: begin
+                        tx_data <= 8'hFF;
+                        xfer_ret <= S_TOKEN_R;
+                        state <= X_PUSH;
+                    end
+                    
+                    S_TOKEN_R: begin
+                        if (rx == 8'hFE) begin
+                            count <= 10'd0;
+                            state <= S_DATA;
+                        end else if (tries == TOKEN_TRIES - 1) begin
+                            read_fail <= 1'b1;
+                            rel_ret <= S_DONE;
+                            state <= S_RELEASE;
+                        end else begin
+                            tries <= tries + 1;
+                            state <= S_TOKEN;
+                        end
+                    end
+                    
+                    S_DATA: begin
+                        if (count == 10'd512) begin
+                            count <= 10'd0;
+                            state <= S_CRC;
+                        end else begin
+                            tx_data <= 8'hFF;
+                            xfer_ret <= S_DATA_W;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    S_DATA_W: begin
+                        count <= count + 1;
+                        state <= S_DATA;
+                    end
+                    
+                    S_CRC: begin
+                        // Read and ignored
+                        if (count == 10'd2) begin
+                            rel_ret <= S_DONE;
+                            state <= S_RELEASE;
+                        end else begin
+                            tx_data <= 8'hFF;
+                            count <= count + 1;
+                            xfer_ret <= S_CRC;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    S_RELEASE: begin
+                        hold_cs <= 1'b0;
+                        no_cs <= 1'b1;
+                        tx_data <= 8'hFF;
+                        count <= 10'd0;
+                        xfer_ret <= rel_ret;
+                        state <= X_PUSH;
+                    end
+                    
+                    S_DONE: begin
+                        read_done <= !read_fail;
+                        read_error <= read_fail;
+                        read_fail <= 1'b0;
+                        state <= S_READY;
+                    end
+                    
+                    S_ERROR: begin
+                        // A read request retries init, as sd_read_sector does;
+                        // the read itself is reported failed
+                        init_error <= 1'b1;
+                        hold_cs <= 1'b0;
+                        if (read_start) begin
+                            read_error <= 1'b1;
+                            init_error <= 1'b0;
+                            slow <= 1'b1;
+                            count <= 10'd0;
+                            tries <= 14'd0;
+                            state <= S_POWER;
+                        end
+                    end
+                    
+                    C_SEND: begin
+                        hold_cs <= 1'b1;
+                        no_cs <= 1'b0;
+                        if (count == 10'd6) begin
+                            count <= 10'd0;
+                            state <= C_POLL;
+                        end else begin
+                            case (count[2:0])
+                                3'd0: tx_data <= {{2'b01, cmd_index}};
+                                3'd1: tx_data <= cmd_arg[31:24];
+                                3'd2: tx_data <= cmd_arg[23:16];
+                                3'd3: tx_data <= cmd_arg[15:8];
+                                3'd4: tx_data <= cmd_arg[7:0];
+                                default: tx_data <= cmd_crc;
+                            endcase
+                            count <= count + 1;
+                            xfer_ret <= C_SEND;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    C_POLL: begin
+                        if (count != 10'd0 && (rx != 8'hFF || count == 10'd10)) begin
+                            r1 <= rx;
+                            count <= 10'd0;
+                            state <= cmd_ret;
+                        end else begin
+                            tx_data <= 8'hFF;
+                            count <= count + 1;
+                            xfer_ret <= C_POLL;
+                            state <= X_PUSH;
+                        end
+                    end
+                    
+                    X_PUSH: begin
+                        if (tx_ready) state <= X_WAIT;
+                    end
+                    
+                    X_WAIT: begin
+                        if (rx_valid) begin
+                            rx <= rx_data;
+                            state <= xfer_ret;
+                        end
+                    end
+                    
+                    default: state <= S_ABSENT;
+                endcase
+            end
+        end
+    end
+endmodule"""
+    
+    def _timed_state_machine(self):
+        boot, tick = self.boot_timer, self.slice_timer
+        self.ir.section()
+        self.ir.comment(f"""    // ============================================
+    // Main State Machine
+    // ============================================
+    // Leaves IDLE after the boot delay ({boot.source}, {boot.period_us} us), then
+    // steps once per {tick.source} period ({tick.period_us} us)""")
+        self.ir.text(self._state_localparams())
+        self.ir.comment("    ")
+        self.ir.always(f"""    always @(*) begin
+        next_state = current_state;
+        
+        case (current_state)
+            STATE_IDLE: begin
+                if ({boot.name}_tick) begin
+                    next_state = STATE_INIT;
+                end
+            end
+            
+            STATE_INIT: begin
+                if ({tick.name}_tick) begin
+                    next_state = STATE_RUN;
+                end
+            end
+            
+            STATE_RUN: begin
+                if ({tick.name}_tick) begin
+                    next_state = STATE_WAIT;
+                end
+            end
+            
+            STATE_WAIT: begin
+                if ({tick.name}_tick) begin
+                    next_state = STATE_RUN;
+                end
+            end
+            
+            default: begin
+                next_state = STATE_IDLE;
+            end
+        endcase
+    end""", drives=['next_state'], reads=['current_state', f"{boot.name}_tick", f"{tick.name}_tick"])
+    
+    def _rom_file(self, rom: RomInfo) -> str:
+        return f"{self.module_name}_{rom.name}.hex"
+    
+    def _rom_instances(self):
+        """One synchronous ROM per static const table, contents in a .hex side
+        file; tables nothing reads are dropped with their ROM"""
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // Constant Tables (ROM)
+    // ============================================""")
+        
+        for rom in self.info['roms']:
+            depth = len(rom.values)
+            addr_bits = max(1, (depth - 1).bit_length())
+            dims = ''.join(f"[{d}]" for d in rom.dims)
+            if len(rom.dims) == 1:
+                index = "index"
+            elif len(rom.dims) == 2:
+                index = f"row * {rom.dims[1]} + col"
+            else:
+                index = "row-major index"
+            if rom.origin:
+                ir.comment(f"\n    // {rom.name}: built from the {rom.origin}")
+            else:
+                ir.comment(f"\n    // {rom.name}: static const {rom.c_type} {rom.name}{dims}, address = {index}")
+            if self.display and self.display.init_rom == rom.name:
+                ir.wire(f"{rom.name}_addr", addr_bits - 1, comment="Driven by the display sequencer")
+            else:
+                ir.reg(f"{rom.name}_addr", addr_bits - 1, init=f"{addr_bits}'d0")
+            ir.wire(f"{rom.name}_data", rom.width - 1, signed=rom.signed)
+            ir.comment("    ")
+            ir.instance(f"{self.module_name}_rom", f"{rom.name}_rom", [
+                ('WIDTH', str(rom.width)),
+                ('DEPTH', str(depth)),
+                ('ADDR_BITS', str(addr_bits)),
+                ('INIT_FILE', f'"{self._rom_file(rom)}"'),
+            ], [
+                ('clk', 'clk', 'in'),
+                ('addr', f"{rom.name}_addr", 'in'),
+                ('data', f"{rom.name}_data", 'out'),
+            ])
+    
+    def _rom_images(self):
+        """.hex side files for the ROMs that survived dead-signal elimination"""
+        for rom in self.info['roms']:
+            if self.ir.has(f"{rom.name}_data"):
+                digits = (rom.width + 3) // 4
+                self.side_files[self._rom_file(rom)] = ''.join(f"{v:0{digits}x}\n" for v in rom.values)
+    
+    def _rom_module(self) -> str:
+        return f"""// ============================================================
+// Synchronous ROM, one cycle read latency (infers block RAM)
+// ============================================================
+module {self.module_name}_rom #(
+    parameter WIDTH = 8,
+    parameter DEPTH = 256,
+    parameter ADDR_BITS = 8,
+    parameter INIT_FILE = ""
+) (
+    input wire clk,
+    input wire [ADDR_BITS-1:0] addr,
+    output reg [WIDTH-1:0] data
+);
+    reg [WIDTH-1:0] mem [0:DEPTH-1];
+    
+    initial begin
+        $readmemh(INIT_FILE, mem);
+    end
+    
+    always @(posedge clk) begin
+        data <= mem[addr];
+    end
+endmodule"""
+    
+    def _oled_logic(self):
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // OLED Display Logic
+    // ============================================""")
+        
+        # Create wires for button inputs; a pulled-up button reads low when pressed
+        if self.info['has_buttons']:
+            ir.comment("    \n    // Button inputs for cursor control")
+            for pin in self._get_button_inputs()[:4]:  # Up, Down, Left, Right
+                level = "!" if pin.mode == 'INPUT_PULLUP' else ""
+                ir.wire(f"{pin.name}_pressed", init=f"{level}{pin.name}_debounced", reads=[f"{pin.name}_debounced"])
+            ir.comment("    ")
+        
+        cursor = ["""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            pixel_x <= OLED_WIDTH / 2;
+            pixel_y <= OLED_HEIGHT / 2;
+        end else begin
+            // Move cursor based on button inputs"""]
+        reads = ['pixel_x', 'pixel_y']
+        
+        # Add button-based movement if we have buttons
+        if self.info['has_buttons']:
+            moves = {
+                'up': "if ({}_pressed && pixel_y > 0) pixel_y <= pixel_y - 1;",
+                'down': "if ({}_pressed && pixel_y < OLED_HEIGHT - 1) pixel_y <= pixel_y + 1;",
+                'left': "if ({}_pressed && pixel_x > 0) pixel_x <= pixel_x - 1;",
+                'right': "if ({}_pressed && pixel_x < OLED_WIDTH - 1) pixel_x <= pixel_x + 1;",
+            }
+            buttons = self._cursor_buttons()
+            for direction, move in moves.items():
+                name = buttons.get(direction)
+                if name:
+                    cursor.append("            " + move.format(name))
+                    reads.append(f"{name}_pressed")
+        else:
+            # Auto-move as fallback
+            cursor.append("""            // Auto-move (demo)
+            if (counter[20:0] == 21'h1FFFFF) begin
+                if (pixel_x < OLED_WIDTH - 1)
+                    pixel_x <= pixel_x + 1;
+                else
+                    pixel_x <= 0;
+            end""")
+            reads.append('counter')
+        cursor.append("        end\n    end")
+        ir.comment("\n    // Cursor movement")
+        ir.always('\n'.join(cursor), drives=['pixel_x', 'pixel_y'], reads=reads)
+        
+        ir.keep('fb_scan_addr', 'fb_scan_data')
+        ir.comment("""    
+
+    // Framebuffer: one byte per 8-pixel column of a page, in a synchronous
+    // RAM. Port A belongs to the engine below, port B is the scan-out read
+    // port (fb_scan_addr / fb_scan_data, one cycle latency)""")
+        ir.text("""    parameter FB_DUAL_PORT = 1;     // 0 builds a single-port RAM, no scan-out port
+    localparam FB_BYTES = OLED_WIDTH * OLED_PAGES;
+    localparam FB_ADDR_BITS = $clog2(FB_BYTES);""")
+        ir.reg('fb_scan_addr', 'FB_ADDR_BITS-1', init='0')
+        ir.wire('fb_scan_data', 7)
+        ir.wire('fb_we')
+        ir.wire('fb_addr', 'FB_ADDR_BITS-1')
+        ir.wire('fb_wdata', 7)
+        ir.wire('fb_rdata', 7)
+        ir.comment("    ")
+        ir.instance(f"{self.module_name}_framebuffer", 'framebuffer', [
+            ('WIDTH', '8'),
+            ('DEPTH', 'FB_BYTES'),
+            ('ADDR_BITS', 'FB_ADDR_BITS'),
+            ('DUAL_PORT', 'FB_DUAL_PORT'),
+        ], [
+            ('clk', 'clk', 'in'),
+            ('a_we', 'fb_we', 'in'),
+            ('a_addr', 'fb_addr', 'in'),
+            ('a_wdata', 'fb_wdata', 'in'),
+            ('a_rdata', 'fb_rdata', 'out'),
+            ('b_addr', 'fb_scan_addr', 'in'),
+            ('b_rdata', 'fb_scan_data', 'out'),
+        ])
+        
+        ir.comment("""    
+    // Framebuffer engine: walks every address clearing the RAM after reset,
+    // then moves the cursor pixel with one read-modify-write per byte
+    // (erase at the drawn position, draw at the new one), one port access
+    // per cycle""")
+        names = ['CLEAR', 'IDLE', 'ERASE_READ', 'ERASE', 'DRAW_READ', 'DRAW']
+        ir.text(f"    localparam{ir.bits('fb_state')}\n" + ',\n'.join(
+            f"        FB_{s:<11}= {ir.lit('fb_state', i)}" for i, s in enumerate(names)) + ';')
+        ir.reg('fb_state', 2, max_value=5)
+        ir.reg('fb_clear_addr', 'FB_ADDR_BITS-1')
+        ir.reg('fb_drawn', comment="A cursor pixel is set at fb_drawn_x/y")
+        ir.reg('fb_drawn_x', 15)
+        ir.reg('fb_drawn_y', 15)
+        ir.reg('fb_x', 15, comment="Position being drawn, latched from pixel_x/y")
+        ir.reg('fb_y', 15)
+        ir.wire('fb_drawn_idx', 'FB_ADDR_BITS-1', init="(fb_drawn_y >> 3) * OLED_WIDTH + fb_drawn_x",
+                reads=['fb_drawn_x', 'fb_drawn_y'])
+        ir.wire('fb_idx', 'FB_ADDR_BITS-1', init="(fb_y >> 3) * OLED_WIDTH + fb_x", reads=['fb_x', 'fb_y'])
+        ir.comment("    ")
+        ir.assign('fb_we', "(fb_state == FB_CLEAR) || (fb_state == FB_ERASE) || (fb_state == FB_DRAW)",
+                  reads=['fb_state'])
+        ir.assign('fb_addr', """(fb_state == FB_CLEAR) ? fb_clear_addr :
+                     (fb_state == FB_ERASE_READ || fb_state == FB_ERASE) ? fb_drawn_idx : fb_idx""",
+                  reads=['fb_state', 'fb_clear_addr', 'fb_drawn_idx', 'fb_idx'])
+        ir.assign('fb_wdata', """(fb_state == FB_CLEAR) ? 8'h00 :
+                      (fb_state == FB_ERASE) ? fb_rdata & ~(8'd1 << fb_drawn_y[2:0]) :
+                                               fb_rdata | (8'd1 << fb_y[2:0])""",
+                  reads=['fb_state', 'fb_rdata', 'fb_drawn_y', 'fb_y'])
+        ir.comment("    ")
+        ir.always("""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            fb_state <= FB_CLEAR;
+            fb_clear_addr <= 0;
+            fb_drawn <= 1'b0;
+            fb_drawn_x <= 16'd0;
+            fb_drawn_y <= 16'd0;
+            fb_x <= 16'd0;
+            fb_y <= 16'd0;
+        end else begin
+            case (fb_state)
+                FB_CLEAR: begin
+                    fb_clear_addr <= fb_clear_addr + 1;
+                    if (fb_clear_addr == FB_BYTES - 1) begin
+                        fb_state <= FB_IDLE;
+                    end
+                end
+                
+                FB_IDLE: begin
+                    if (!fb_drawn || pixel_x != fb_drawn_x || pixel_y != fb_drawn_y) begin
+                        fb_x <= pixel_x;
+                        fb_y <= pixel_y;
+                        fb_state <= fb_drawn ? FB_ERASE_READ : FB_DRAW_READ;
+                    end
+                end
+                
+                FB_ERASE_READ: fb_state <= FB_ERASE;
+                FB_ERASE:      fb_state <= FB_DRAW_READ;
+                FB_DRAW_READ:  fb_state <= FB_DRAW;
+                
+                FB_DRAW: begin
+                    fb_drawn <= 1'b1;
+                    fb_drawn_x <= fb_x;
+                    fb_drawn_y <= fb_y;
+                    fb_state <= FB_IDLE;
+                end
+                
+                default: begin
+                    fb_state <= FB_IDLE;
+                end
+            endcase
+        end
+    end""", drives=['fb_state', 'fb_clear_addr', 'fb_drawn', 'fb_drawn_x', 'fb_drawn_y', 'fb_x', 'fb_y'],
+                  reads=['fb_state', 'fb_clear_addr', 'fb_drawn', 'fb_drawn_x', 'fb_drawn_y',
+                         'fb_x', 'fb_y', 'pixel_x', 'pixel_y'])
+    
+    def _framebuffer_module(self) -> str:
+        return f"""// ============================================================
+// Framebuffer RAM: port A read/write, port B read-only, both synchronous
+// with one cycle read latency and no reset, so it infers block RAM
+// ============================================================
+module {self.module_name}_framebuffer #(
+    parameter WIDTH = 8,
+    parameter DEPTH = 1024,
+    parameter ADDR_BITS = 10,
+    parameter DUAL_PORT = 1         // 0: single port, b_rdata reads as zero
+) (
+    input wire clk,
+    input wire a_we,
+    input wire [ADDR_BITS-1:0] a_addr,
+    input wire [WIDTH-1:0] a_wdata,
+    output reg [WIDTH-1:0] a_rdata,
+    input wire [ADDR_BITS-1:0] b_addr,
+    output reg [WIDTH-1:0] b_rdata
+);
+    reg [WIDTH-1:0] mem [0:DEPTH-1];
+    
+    always @(posedge clk) begin
+        if (a_we) begin
+            mem[a_addr] <= a_wdata;
+        end
+        a_rdata <= mem[a_addr];
+    end
+    
+    generate
+        if (DUAL_PORT) begin : scan_port
+            always @(posedge clk) begin
+                b_rdata <= mem[b_addr];
+            end
+        end else begin : no_scan_port
+            always @(posedge clk) begin
+                b_rdata <= {{WIDTH{{1'b0}}}};
+            end
+        end
+    endgenerate
+endmodule"""
+    
+    def _i2c_logic(self):
+        ir = self.ir
+        ir.section()
+        ir.comment("""    // ============================================
+    // I2C Interface Logic
+    // ============================================
+""")
+        ir.comment("    // I2C State Definitions")
+        names = ['IDLE', 'START', 'ADDR', 'DATA', 'STOP']
+        ir.text(f"    localparam{ir.bits('i2c_state')}\n" + ',\n'.join(
+            f"        I2C_{s:<10}= {ir.lit('i2c_state', i)}" for i, s in enumerate(names)) + ';')
+        div = lambda value: ir.lit('i2c_clk_div', value)
+        bit = lambda value: ir.lit('i2c_bit_counter', value)
+        ir.comment("    \n    // I2C clock enable for 100kHz (assuming 50MHz system clock)")
+        ir.assign('i2c_clk_enable', f"(i2c_clk_div == {div(249)})", reads=['i2c_clk_div'])
+        ir.comment("    \n    // I2C clock divider")
+        ir.always(f"""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            i2c_clk_div <= {div(0)};
+        end else begin
+            if (i2c_clk_div == {div(499)}) begin
+                i2c_clk_div <= {div(0)};
+            end else begin
+                i2c_clk_div <= i2c_clk_div + {div(1)};
+            end
+        end
+    end""", drives=['i2c_clk_div'], reads=['i2c_clk_div'])
+        ir.comment("    \n    // I2C state machine")
+        ir.always(f"""    always @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            i2c_state <= I2C_IDLE;
+            i2c_bit_counter <= {bit(7)};
             i2c_write_active <= 1'b0;
+            i2c_address <= 7'h3C;
+            i2c_data_out <= 8'h00;
         end else if (i2c_clk_enable) begin
             case (i2c_state)
                 I2C_IDLE: begin
@@ -604,19 +3363,19 @@ class PerfectedGenerator:
                 end
                 
                 I2C_ADDR: begin
-                    if (i2c_bit_counter == 3'd0) begin
+                    if (i2c_bit_counter == {bit(0)}) begin
                         i2c_state <= I2C_DATA;
-                        i2c_bit_counter <= 3'd7;
+                        i2c_bit_counter <= {bit(7)};
                     end else begin
-                        i2c_bit_counter <= i2c_bit_counter - 1;
+                        i2c_bit_counter <= i2c_bit_counter - {bit(1)};
                     end
                 end
                 
                 I2C_DATA: begin
-                    if (i2c_bit_counter == 3'd0) begin
+                    if (i2c_bit_counter == {bit(0)}) begin
                         i2c_state <= I2C_STOP;
                     end else begin
-                        i2c_bit_counter <= i2c_bit_counter - 1;
+                        i2c_bit_counter <= i2c_bit_counter - {bit(1)};
                     end
                 end
                 
@@ -630,12 +3389,19 @@ class PerfectedGenerator:
                 end
             endcase
         end
-    end
-    
-    // I2C output signal generation
-    always @(posedge clk or negedge rst_n) begin
+    end""", drives=['i2c_state', 'i2c_bit_counter', 'i2c_write_active', 'i2c_address', 'i2c_data_out'],
+                  reads=['i2c_clk_enable', 'i2c_state', 'i2c_write_active', 'i2c_bit_counter'])
+        
+        sda = next((p.name for p in self.pins if p.is_i2c and 'sda' in p.name.lower()), None)
+        scl = next((p.name for p in self.pins if p.is_i2c and 'scl' in p.name.lower()), None)
+        if not sda or not scl:
+            return
+        ir.comment("    \n    // I2C output signal generation")
+        ir.always(f"""    always @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            // I2C pins set to idle high in reset block
+            // I2C idle high
+            {sda} <= 1'b1;
+            {scl} <= 1'b1;
         end else if (i2c_clk_enable) begin
             case (i2c_state)
                 I2C_IDLE: begin
@@ -644,80 +3410,493 @@ class PerfectedGenerator:
                 
                 I2C_START: begin
                     // Start condition: SDA goes low while SCL is high
-                    SDA <= 1'b0;
+                    {sda} <= 1'b0;
                 end
                 
                 I2C_ADDR: begin
                     // Generate clock pulse and output address bit
-                    SCL <= ~SCL;  // Toggle SCL
-                    if (!SCL) begin  // On falling edge of SCL
-                        SDA <= i2c_address[i2c_bit_counter];
+                    {scl} <= ~{scl};  // Toggle SCL
+                    if (!{scl}) begin  // On falling edge of SCL
+                        {sda} <= i2c_address[i2c_bit_counter];
                     end
                 end
                 
                 I2C_DATA: begin
                     // Generate clock pulse and output data bit
-                    SCL <= ~SCL;
-                    if (!SCL) begin  // On falling edge of SCL
-                        SDA <= i2c_data_out[i2c_bit_counter];
+                    {scl} <= ~{scl};
+                    if (!{scl}) begin  // On falling edge of SCL
+                        {sda} <= i2c_data_out[i2c_bit_counter];
                     end
                 end
                 
                 I2C_STOP: begin
                     // Stop condition: SDA goes high while SCL is high
-                    SCL <= 1'b0;
-                    SDA <= 1'b0;
-                    SCL <= 1'b1;
-                    SDA <= 1'b1;
+                    {scl} <= 1'b0;
+                    {sda} <= 1'b0;
+                    {scl} <= 1'b1;
+                    {sda} <= 1'b1;
                 end
             endcase
         end
-    end""")
+    end""", drives=[sda, scl], reads=['i2c_clk_enable', 'i2c_state', 'i2c_address', 'i2c_data_out',
+                                         'i2c_bit_counter', scl])
+    
+    # ============================================================
+    # Testbench
+    # ============================================================
+    
+    TB_CLK_HZ = 1000000     # One cycle per microsecond keeps C timer periods short to simulate
+    
+    def _display_init_us(self) -> int:
+        """Sum of the delays in the display init table"""
+        d = self.display
+        rom = next(r for r in self.info['roms'] if r.name == d.init_rom)
+        fmt = d.step_format
+        total, i = 0, 0
+        while i + 1 < len(rom.values):
+            flags = rom.values[i + 1]
+            i += 2 + (flags & fmt['LEN_MASK'])
+            if flags & fmt['DELAY'] and i < len(rom.values):
+                total += rom.values[i] * 1000
+                i += 1
+        return total
+    
+    # Bytes the SD controller shifts before init_error when no card answers:
+    # power-up clocks, then ten CMD0 attempts of release byte, command, R1 poll
+    SD_GIVE_UP_BYTES = 10 + 10 * (1 + 6 + 10)
+    
+    def _tb_settle_cycles(self) -> int:
+        """Testbench cycles after reset by which the end-of-run checks hold:
+        the boot delay and two state machine steps, the display init delays
+        plus every table byte through the SPI master (a pseudo op sends no
+        more bytes than it takes in the table), SD init giving up and the
+        framebuffer clear"""
+        us = self.TB_CLK_HZ // 1000000
+        # 16 SCK half periods per byte, plus the FIFO and rx_valid handshake
+        byte = lambda div: 16 * max(1, div) + 4
+        cycles = 0
+        if self.timed:
+            cycles = max(cycles, (self.boot_timer.period_us + 2 * self.slice_timer.period_us) * us)
+        if self.display:
+            rom = next(r for r in self.info['roms'] if r.name == self.display.init_rom)
+            cycles = max(cycles, self._display_init_us() * us + len(rom.values) * byte(self.SPI_CLK_DIV))
+        if self.sd:
+            slow = self.TB_CLK_HZ // (2 * self.SD_INIT_SCK_HZ)
+            cycles = max(cycles, self.SD_GIVE_UP_BYTES * byte(slow))
+        if self.info['has_oled']:
+            # Framebuffer clear, one byte per cycle over OLED_PAGES = 8 pages
+            cycles = max(cycles, self._oled_size()[0] * 8 + 16)
+        return cycles
+    
+    def _testbench(self) -> str:
+        """Self-checking testbench: clock, reset, a scripted pass over the
+        inputs and checks on what the generated cores must have done"""
+        m = self.module_name
+        inputs = [p for p in self.pins if p.direction == 'input']
+        outputs = [p for p in self.pins if p.direction == 'output']
+        miso = {bus.miso for bus in self.spi_buses}
+        card_detect = self.sd.cd if self.sd else None
+        pulsed = [p for p in inputs if p.name not in miso and p.name != card_detect]
+        debounced = [p for p in pulsed if self.ir.has(f"{p.name}_debounced")]
+        steps = 2 * len(pulsed) + 2
+        # Each press and release is held past the debounce period
+        hold = self.debounce_us * self.TB_CLK_HZ // 1000000 + 1000
+        
+        # Long enough for the stimulus and for every core to get where the
+        # end-of-run checks expect it, plus reset
+        cycles = max(steps * hold, self._tb_settle_cycles() + 1000)
+        
+        def idle(pin):
+            return "1'b1" if pin.mode == 'INPUT_PULLUP' or pin.name in miso else "1'b0"
+        
+        def active(pin):
+            return "1'b0" if pin.mode == 'INPUT_PULLUP' else "1'b1"
+        
+        # Where the OLED cursor ends up: each press is held 1000 cycles past
+        # the debounce and the cursor moves a pixel per cycle, so it runs to
+        # the edge
+        oled = self.info['has_oled'] and self.ir.has('fb_state')
+        if oled:
+            width, height = self._oled_size()
+            x, y = width // 2, height // 2
+            edges = {'up': ('y', 0), 'down': ('y', height - 1), 'left': ('x', 0), 'right': ('x', width - 1)}
+            moved = {name: edges[d] for d, name in self._cursor_buttons().items()}
+            for pin in pulsed:
+                axis, edge = moved.get(pin.name, (None, 0))
+                if axis == 'x':
+                    x = edge
+                elif axis == 'y':
+                    y = edge
+        
+        lines = []
+        lines.append(f"""`timescale 1ns / 1ps
+// ============================================================
+// Self-checking testbench for {m}
+// Generated by Perfected Wokwi2Verilog Converter
+// Run length: +cycles=N (default {cycles}); prints PASS or FAIL
+// ============================================================
+module {m}_tb;
+    parameter CLK_HZ = {self.TB_CLK_HZ};
+    
+    reg clk = 1'b0;
+    reg rst_n = 1'b0;
+    integer cycles = 0;
+    integer limit = {cycles};
+    integer errors = 0;
+    integer hold;
+    """)
+        if oled:
+            lines.append("    parameter FB_DUAL_PORT = 1;     // Framebuffer RAM build, -P/-G to override")
+            lines.append("    integer i;")
+            lines.append("    integer set_bytes;")
+            lines.append("    ")
+        if inputs:
+            lines.append("    // Inputs at their idle levels")
+            for pin in inputs:
+                lines.append(f"    reg {pin.name} = {idle(pin)};")
+            lines.append("    ")
+        if outputs:
+            lines.append("    // Outputs")
+            for pin in outputs:
+                lines.append(f"    wire {pin.name};")
+            lines.append("    ")
+        
+        ports = ["        .clk(clk)", "        .rst_n(rst_n)"] + [f"        .{p.name}({p.name})" for p in self.pins]
+        overrides = ["        .CLK_HZ(CLK_HZ)"] if self._has_clk_hz() else []
+        if oled:
+            overrides.append("        .FB_DUAL_PORT(FB_DUAL_PORT)")
+        params = " #(\n" + ',\n'.join(overrides) + "\n    )" if overrides else ""
+        lines.append(f"    {m}{params} dut (\n" + ',\n'.join(ports) + "\n    );")
+        lines.append(f"""    
+    always #5 clk = ~clk;
+    
+    always @(posedge clk) begin
+        cycles <= cycles + 1;
+    end
+    
+    task check(input ok, input [8*64-1:0] what);
+        begin
+            if (!ok) begin
+                errors = errors + 1;
+                $display("FAIL at cycle %0d: %0s", cycles, what);
+            end
+        end
+    endtask
+    
+    initial begin
+        if ($value$plusargs("cycles=%d", limit)) begin
+            $display("Running %0d cycles", limit);
+        end
+        hold = limit / {steps};
+        if (hold < {hold}) hold = {hold};      // Longer than the {self.debounce_us} us debounce
+        repeat (4) @(posedge clk);
+        rst_n = 1'b1;
+        @(posedge clk);
+        #1;
         
-        return '\n'.join(logic)
+        // Out of reset""")
+        for pin in outputs:
+            if pin.is_power:
+                lines.append(f'        check({pin.name} === {pin.init_value}, "{pin.name} at its supply level");')
+        for bus in self.spi_buses:
+            if bus.cs:
+                lines.append(f'        check({bus.cs} === 1\'b1, "{bus.cs} deselected");')
+            lines.append(f'        check({bus.sck} === 1\'b0, "{bus.sck} idle low (mode 0)");')
+        for uart in self.uarts:
+            lines.append(f'        check({uart.tx} === 1\'b1, "{uart.tx} idle high");')
+        
+        # Scripted stimulus
+        lines.append("        ")
+        if card_detect:
+            lines.append("        // Stimulus: card present throughout, other inputs pressed and released in turn")
+            pin = next(p for p in inputs if p.name == card_detect)
+            lines.append(f"        {card_detect} = {active(pin)};")
+        else:
+            lines.append("        // Stimulus: inputs pressed and released in turn")
+        for pin in pulsed:
+            lines.append("        repeat (hold) @(posedge clk);")
+            lines.append(f"        {pin.name} = {active(pin)};")
+            lines.append("        repeat (hold) @(posedge clk);")
+            if pin in debounced:
+                lines.append(f'        check(dut.{pin.name}_debounced === {active(pin)}, "{pin.name} press seen after debounce");')
+            lines.append(f"        {pin.name} = {idle(pin)};")
+        if debounced:
+            lines.append("        repeat (hold) @(posedge clk);")
+            for pin in debounced:
+                lines.append(f'        check(dut.{pin.name}_debounced === {idle(pin)}, "{pin.name} release seen after debounce");')
+        lines.append("        wait (cycles >= limit);")
+        lines.append("        #1;")
+        
+        # End state
+        lines.append("        ")
+        lines.append("        // After the run")
+        for pin in outputs:
+            if pin.is_power:
+                lines.append(f'        check({pin.name} === {pin.init_value}, "{pin.name} still at its supply level");')
+        if self.timed and self.ir.has('current_state'):
+            lines.append('        check(dut.current_state != dut.STATE_IDLE, "boot timer left STATE_IDLE");')
+        if self.display:
+            lines.append('        check(dut.display_ready === 1\'b1, "display init sequence finished");')
+            if self.display.rst:
+                lines.append(f'        check({self.display.rst} === 1\'b1, "panel out of reset");')
+        if self.sd and card_detect:
+            lines.append('        check(dut.sd_init_error === 1\'b1, "SD init fails with no card answering");')
+        if oled:
+            # Byte (y / 8) * width + x of the framebuffer holds pixel bit y % 8
+            index = (y >> 3) * width + x
+            lines.append(f'        check(dut.pixel_x == {x} && dut.pixel_y == {y}, "cursor at ({x}, {y})");')
+            lines.append(f'        check(dut.framebuffer.mem[{index}] === 8\'h{1 << (y & 7):02x}, '
+                         f'"cursor pixel drawn in byte {index}");')
+            lines.append("        set_bytes = 0;")
+            lines.append(f"        for (i = 0; i < {width * 8}; i = i + 1) begin")
+            lines.append("            if (dut.framebuffer.mem[i] !== 8'h00) set_bytes = set_bytes + 1;")
+            lines.append("        end")
+            lines.append('        check(set_bytes == 1, "old cursor pixels erased");')
+        lines.append(f"""        
+        if (errors == 0) begin
+            $display("PASS {m}: %0d cycles", cycles);
+        end else begin
+            $display("FAIL {m}: %0d errors", errors);
+        end
+        $finish;
+    end
+endmodule
+""")
+        return '\n'.join(lines)
+
+def module_name_for(path: str) -> str:
+    module_name = Path(path).stem
+    module_name = re.sub(r'[^a-zA-Z0-9_]', '_', module_name)
+    if not module_name[0].isalpha():
+        module_name = 'chip_' + module_name
+    return module_name
+
+def convert_file(input_path: str, output_path: Optional[str] = None, verbose: bool = False,
+                 testbench: bool = False, module_name: Optional[str] = None) -> Tuple[str, float, List[str]]:
+    """Convert one C chip source, returns (output file, seconds taken, side files written).
+    The module is named after the source file unless module_name is given."""
+    start = time.perf_counter()
+    with open(input_path, 'r') as f:
+        content = f.read()
+    
+    # Parse C code
+    parser = PerfectedParser()
+    info = parser.parse(content)
+    
+    module_name = module_name or module_name_for(input_path)
+    
+    if verbose:
+        print(f"Converting {input_path}...")
+        print(f"  Module: {module_name}")
+        print(f"  Defines: {len(info['defines'])}")
+        print(f"  Pins: {len(info['pins'])}")
+        print(f"  OLED: {info['has_oled']}")
+        print(f"  I2C: {info['has_i2c']}")
+        print(f"  SPI buses: {', '.join(bus.name for bus in info['spi_buses']) or 'none'}")
+        if info['display']:
+            print(f"  Display: {info['display'].init_rom} on {info['display'].bus}, "
+                  f"init from {info['display'].source}")
+        if info['sd']:
+            print(f"  SD card: {info['sd'].bus}")
+        for uart in info['uarts']:
+            print(f"  UART: {uart.name} TX={uart.tx} at {uart.baud} baud")
+        print(f"  Timers: {', '.join(f'{t.name} {t.period_us} us' for t in info['timers']) or 'none'}")
+        for t in info['timers']:
+            if not t.periodic and t.armed_by_pins:
+                print(f"    {t.name}: one-shot re-armed on input edges, sets the button debounce period")
+            elif not t.periodic and not t.started_at_init:
+                print(f"    {t.name}: one-shot never started in chip_init, no tick generated")
+    
+    for warning in info['warnings']:
+        print(f"  Warning: {warning}")
+    
+    # Generate Verilog
+    generator = PerfectedGenerator(info, module_name, testbench)
+    verilog = generator.generate()
+    if verbose:
+        for warning in generator.ir.warnings:
+            print(f"  Warning: {warning}")
+    
+    # Write output, side files (ROM images, testbench) go next to it
+    output_file = output_path or f"{module_name}.v"
+    with open(output_file, 'w') as f:
+        f.write(verilog)
+    side_files = [os.path.join(os.path.dirname(output_file), name) for name in generator.side_files]
+    for path, data in zip(side_files, generator.side_files.values()):
+        with open(path, 'w') as f:
+            f.write(data)
+    
+    return output_file, time.perf_counter() - start, side_files
+
+# ============================================================
+# Batch mode
+# ============================================================
+
+CACHE_MANIFEST = '.wokwi2verilog-cache.json'
+
+def converter_version() -> str:
+    """Release version plus a digest of this file, so any converter change
+    invalidates cached outputs"""
+    with open(os.path.abspath(__file__), 'rb') as f:
+        return f"{__version__}+{hashlib.sha256(f.read()).hexdigest()[:12]}"
+
+def source_hash(path: str) -> str:
+    with open(path, 'rb') as f:
+        return hashlib.sha256(f.read()).hexdigest()
+
+def collect_sources(patterns: List[str]) -> List[str]:
+    """C files named by paths, directories (searched recursively) or globs"""
+    sources = []
+    seen = set()
+    for pattern in patterns:
+        if os.path.isdir(pattern):
+            matches = sorted(str(p) for p in Path(pattern).rglob('*.c'))
+        elif os.path.exists(pattern):
+            matches = [pattern]
+        else:
+            matches = sorted(glob.glob(pattern, recursive=True))
+        for path in matches:
+            key = os.path.abspath(path)
+            if key not in seen:
+                seen.add(key)
+                sources.append(path)
+    return sources
+
+def _batch_job(job):
+    source, output, module_name, verbose, testbench = job
+    try:
+        _, seconds, side_files = convert_file(source, output, verbose, testbench, module_name)
+        return source, output, side_files, seconds, None
+    except Exception as e:
+        return source, output, [], 0.0, f"{type(e).__name__}: {e}"
+
+def batch_module_names(sources: List[str], out_dir: Optional[str]) -> Dict[str, str]:
+    """Module (and output file) name per source. Sources that would write the
+    same output, e.g. a/foo.c and b/foo.c into one --out-dir, are named after
+    their paths below the directory they share instead (a_foo, b_foo)."""
+    names = {source: module_name_for(source) for source in sources}
+    groups: Dict[str, List[str]] = {}
+    for source in sources:
+        output = os.path.join(out_dir or os.path.dirname(source), names[source] + '.v')
+        groups.setdefault(os.path.abspath(output), []).append(source)
+    for group in groups.values():
+        if len(group) > 1:
+            common = os.path.commonpath([os.path.abspath(s) for s in group])
+            for source in group:
+                rel = os.path.splitext(os.path.relpath(os.path.abspath(source), common))[0]
+                names[source] = module_name_for(rel.replace(os.sep, '_') + '.c')
+    return names
+
+def run_batch(patterns: List[str], out_dir: Optional[str], jobs: Optional[int], use_cache: bool,
+              verbose: bool = False, testbench: bool = False) -> int:
+    start = time.perf_counter()
+    sources = collect_sources(patterns)
+    if not sources:
+        print("Error: No C files found")
+        return 1
+    
+    # Outputs go next to each source unless --out-dir is given
+    if out_dir:
+        os.makedirs(out_dir, exist_ok=True)
+    manifest_path = os.path.join(out_dir or '.', CACHE_MANIFEST)
+    manifest = {}
+    if use_cache and os.path.exists(manifest_path):
+        try:
+            with open(manifest_path) as f:
+                manifest = json.load(f)
+        except (OSError, ValueError):
+            manifest = {}
+    
+    # Every output path is settled before any worker writes one
+    names = batch_module_names(sources, out_dir)
+    outputs = {source: os.path.join(out_dir or os.path.dirname(source), names[source] + '.v')
+               for source in sources}
+    claimed: Dict[str, str] = {}
+    clashes = 0
+    for source, output in outputs.items():
+        other = claimed.setdefault(os.path.abspath(output), source)
+        if other != source:
+            print(f"Error: {source} and {other} would both write {output}")
+            clashes += 1
+    if clashes:
+        return 1
+    
+    version = converter_version()
+    todo = []
+    skipped = []
+    hashes = {}
+    for source in sources:
+        output = outputs[source]
+        key = os.path.abspath(source)
+        hashes[key] = source_hash(source)
+        entry = manifest.get(key)
+        if (use_cache and entry and entry.get('hash') == hashes[key]
+                and entry.get('version') == version and entry.get('output') == os.path.abspath(output)
+                and entry.get('testbench', False) == testbench and os.path.exists(output)
+                and 'side_files' in entry and all(os.path.exists(p) for p in entry['side_files'])):
+            skipped.append(source)
+        else:
+            todo.append((source, output, names[source], verbose, testbench))
+    
+    results = []
+    if todo:
+        workers = min(jobs or os.cpu_count() or 1, len(todo))
+        if workers > 1:
+            with ProcessPoolExecutor(max_workers=workers) as pool:
+                results = list(pool.map(_batch_job, todo))
+        else:
+            results = [_batch_job(job) for job in todo]
+    
+    failed = 0
+    for source, output, side_files, seconds, error in results:
+        key = os.path.abspath(source)
+        if error:
+            failed += 1
+            manifest.pop(key, None)
+            print(f"✗ {source}: {error}")
+        else:
+            manifest[key] = {'hash': hashes[key], 'version': version, 'output': os.path.abspath(output),
+                             'side_files': [os.path.abspath(p) for p in side_files], 'testbench': testbench}
+            print(f"✓ {source} -> {output} ({seconds * 1000:.1f} ms)")
+    for source in skipped:
+        print(f"= {source} (unchanged, cached)")
+    
+    if use_cache:
+        with open(manifest_path, 'w') as f:
+            json.dump(manifest, f, indent=2, sort_keys=True)
+    
+    total = time.perf_counter() - start
+    converted = len(results) - failed
+    print(f"{len(sources)} files: {converted} converted, {len(skipped)} cached, {failed} failed "
+          f"in {total:.2f} s")
+    return 1 if failed else 0
 
 def main():
     parser = argparse.ArgumentParser(description='PERFECTED Wokwi C to Verilog Converter')
-    parser.add_argument('input', help='Input C file')
-    parser.add_argument('-o', '--output', help='Output Verilog file')
+    parser.add_argument('input', nargs='+', help='Input C file, or files/directories/globs for batch mode')
+    parser.add_argument('-o', '--output', help='Output Verilog file (single input only)')
     parser.add_argument('-v', '--verbose', action='store_true', help='Verbose output')
+    parser.add_argument('--out-dir', help='Batch mode: write all outputs to this directory')
+    parser.add_argument('-j', '--jobs', type=int, help='Batch mode: worker processes (default: CPU count)')
+    parser.add_argument('--no-cache', action='store_true', help='Batch mode: convert everything, ignore the cache manifest')
+    parser.add_argument('--testbench', action='store_true', help='Also write a self-checking <module>_tb.v next to each output')
     
     args = parser.parse_args()
     
-    if not os.path.exists(args.input):
-        print(f"Error: File '{args.input}' not found")
+    input_file = args.input[0]
+    if len(args.input) == 1 and not os.path.exists(input_file) and not glob.has_magic(input_file):
+        print(f"Error: File '{input_file}' not found")
         return 1
     
+    # More than one input, a directory or a glob selects batch mode
+    if len(args.input) > 1 or not os.path.isfile(input_file) or args.out_dir:
+        if args.output:
+            print("Error: -o/--output needs exactly one input file, use --out-dir")
+            return 1
+        return run_batch(args.input, args.out_dir, args.jobs, not args.no_cache, args.verbose, args.testbench)
+    
     try:
-        with open(args.input, 'r') as f:
-            content = f.read()
-        
-        # Parse C code
-        parser = PerfectedParser()
-        info = parser.parse(content)
-        
-        # Module name
-        module_name = Path(args.input).stem
-        module_name = re.sub(r'[^a-zA-Z0-9_]', '_', module_name)
-        if not module_name[0].isalpha():
-            module_name = 'chip_' + module_name
-        
-        if args.verbose:
-            print(f"Converting {args.input}...")
-            print(f"  Module: {module_name}")
-            print(f"  Defines: {len(info['defines'])}")
-            print(f"  Pins: {len(info['pins'])}")
-            print(f"  OLED: {info['has_oled']}")
-            print(f"  I2C: {info['has_i2c']}")
-        
-        # Generate Verilog
-        generator = PerfectedGenerator(info, module_name)
-        verilog = generator.generate()
-        
-        # Write output
-        output_file = args.output or f"{module_name}.v"
-        with open(output_file, 'w') as f:
-            f.write(verilog)
+        output_file, _, _ = convert_file(input_file, args.output, args.verbose, args.testbench)
         
         print(f"✓ Successfully generated {output_file}")
         print("  All issues fixed - Production ready!")